@@ -259,6 +259,12 @@ consoleread(struct inode *ip, char *dst, int n)
       }
       break;
     }
+    if(n == target || (uint)dst % PGSIZE == 0){
+      // back the page of dst before storing to it under cons.lock
+      release(&cons.lock);
+      prefault_uvm(dst, 1);
+      acquire(&cons.lock);
+    }
     *dst++ = c;
     --n;
     if(c == '\n')
@@ -10,6 +10,8 @@ struct sleeplock;
 struct stat;
 struct superblock;
 struct page_data;
+struct zswapstat;
+struct memstat;
 
 // main.c
 extern uint     total_of_pages_in_system;
@@ -62,11 +64,15 @@ int		createSwapFile(struct proc* p);
 int		readFromSwapFile(struct proc * p, char* buffer, uint placeOnFile, uint size);
 int		writeToSwapFile(struct proc* p, char* buffer, uint placeOnFile, uint size);
 int		removeSwapFile(struct proc* p);
+int		copySwapFile(struct proc* src, struct proc* dst);
+void            zswap_getstat(struct zswapstat*);
 
 // ide.c
 void            ideinit(void);
 void            ideintr(void);
 void            iderw(struct buf*);
+void            iderw_start(struct buf*);
+void            iderw_wait(struct buf*);
 
 // ioapic.c
 void            ioapicenable(int irq, int cpu);
@@ -141,6 +147,8 @@ void            copy_meta_data(struct page_data*, struct page_data*);
 void            print_upages(struct page_data*, char*);
 void            print_proc_info(struct proc*);
 void            print_system_info(void);
+void            sample_rss(struct proc*);
+int             get_memstat(int, struct memstat*);
 // swtch.S
 void            swtch(struct context**, struct context*);
 
@@ -200,6 +208,8 @@ void            kvmalloc(void);
 pde_t*          setupkvm(void);
 char*           uva2ka(pde_t*, char*);
 int             allocuvm(pde_t*, uint, uint);
+int             lazy_page_fault(void*, int);
+void            prefault_uvm(char*, uint);
 int             deallocuvm(pde_t*, uint, uint);
 void            freevm(pde_t*);
 void            inituvm(pde_t*, char*, uint);
@@ -210,6 +220,8 @@ void            switchkvm(void);
 int             copyout(pde_t*, uint, void*, uint);
 void            clearpteu(pde_t *pgdir, char *uva);
 void            swap_page_IN(void* va, pde_t*);
+void            swap_page_IN_around(void* va, pde_t*);
+void            note_victim(struct proc*, void*);
 void            swap_page_OUT(pde_t*);
 int             next_min_swapfile_offset(void);
 void            update_min_swapfile_offset(int);
@@ -119,6 +119,8 @@ exec(char *path, char **argv)
   curproc->tf->esp = sp;
 
   #ifndef NONE
+    curproc->last_fault_va = 0;
+    curproc->fault_window = 1;
     // init swapfile
     if(curproc->pid>2){
       if(removeSwapFile(curproc)!=0){
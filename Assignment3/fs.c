@@ -14,15 +14,21 @@
 #include "param.h"
 #include "stat.h"
 #include "mmu.h"
+#include "x86.h"
 #include "proc.h"
 #include "spinlock.h"
 #include "sleeplock.h"
 #include "fs.h"
 #include "buf.h"
 #include "file.h"
+#include "zswap.h"
 
 #define min(a, b) ((a) < (b) ? (a) : (b))
+#define max(a, b) ((a) > (b) ? (a) : (b))
 static void itrunc(struct inode*);
+static void swapinit(void);
+static int swapwrite(struct proc*, char*, uint, uint);
+static int swapread(struct proc*, char*, uint, uint, int);
 // there should be one superblock per disk device, but we run with
 // only one device
 struct superblock sb; 
@@ -184,6 +190,7 @@ iinit(int dev)
  inodestart %d bmap start %d\n", sb.size, sb.nblocks,
           sb.ninodes, sb.nlog, sb.logstart, sb.inodestart,
           sb.bmapstart);
+  swapinit();
 }
 
 static struct inode* iget(uint dev, uint inum);
@@ -676,144 +683,564 @@ nameiparent(char *path, char *name)
 
 
 
-#include "fcntl.h"
-#define DIGITS 14
+// Swap area.
+// Paged out memory lives in a raw block range that mkfs reserves
+// right after the file system (sb.swapstart, sb.nswap blocks).
+// The range is handed out in page sized slots and accessed with
+// iderw directly, bypassing the log and the buffer cache.
+// Each process maps the page offsets of its swap "file" to slots
+// through p->swap_slots.
 
-char* itoa(int i, char b[]){
-    char const digit[] = "0123456789";
-    char* p = b;
-    if(i<0){
-        *p++ = '-';
-        i *= -1;
-    }
-    int shifter = i;
-    do{ //Move to where representation ends
-        ++p;
-        shifter = shifter/10;
-    }while(shifter);
-    *p = '\0';
-    do{ //Move back, inserting digits as u go
-        *--p = digit[i%10];
-        i = i/10;
-    }while(i);
-    return b;
+#define SWAPBPP (PGSIZE / BSIZE)  // blocks per swap slot
+
+struct {
+  struct spinlock lock;
+  char used[NSWAPPAGES];
+} swapmap;
+
+// Private bufs for one slot's blocks, which never enter the
+// buffer cache; lock serializes their use.
+struct {
+  struct sleeplock lock;
+  struct buf buf[SWAPBPP];
+} swapio;
+
+static void zswapinit(void);
+
+static void
+swapinit(void)
+{
+  int i;
+
+  initlock(&swapmap.lock, "swapmap");
+  initsleeplock(&swapio.lock, "swapio");
+  for(i = 0; i < SWAPBPP; i++){
+    initsleeplock(&swapio.buf[i].lock, "swapbuf");
+    swapio.buf[i].dev = ROOTDEV;
+  }
+  cprintf("swap: start %d blocks %d\n", sb.swapstart, sb.nswap);
+  zswapinit();
 }
-//remove swap file of proc p;
-int
-removeSwapFile(struct proc* p)
+
+// Allocate a free swap slot. Returns -1 if the swap area is full.
+static int
+swapalloc(void)
 {
-  //path of proccess
-  char path[DIGITS];
-  memmove(path,"/.swap", 6);
-  itoa(p->pid, path+ 6);
+  int i;
+
+  acquire(&swapmap.lock);
+  for(i = 0; i < NSWAPPAGES && i < sb.nswap / SWAPBPP; i++){
+    if(!swapmap.used[i]){
+      swapmap.used[i] = 1;
+      release(&swapmap.lock);
+      return i;
+    }
+  }
+  release(&swapmap.lock);
+  return -1;
+}
 
-  struct inode *ip, *dp;
-  struct dirent de;
-  char name[DIRSIZ];
-  uint off;
+static void
+swapfree(int slot)
+{
+  acquire(&swapmap.lock);
+  if(!swapmap.used[slot])
+    panic("swapfree");
+  swapmap.used[slot] = 0;
+  release(&swapmap.lock);
+}
 
-  if(0 == p->swapFile)
-  {
-    return -1;
+// Move n bytes, all within swap slot slot, between data and
+// offset off of the slot. The transfers of all the blocks are
+// started before waiting for any, so a page costs one wait for
+// its reads (only partly written blocks are read when writing)
+// and one for its writes.
+static void
+swapslot(int slot, char *data, uint off, uint n, int write)
+{
+  struct buf *b;
+  uint i, first, last, lo, hi;
+
+  first = off / BSIZE;
+  last = (off + n - 1) / BSIZE;
+  acquiresleep(&swapio.lock);
+  for(i = first; i <= last; i++){
+    b = &swapio.buf[i];
+    acquiresleep(&b->lock);
+    b->blockno = sb.swapstart + slot*SWAPBPP + i;
+    b->flags = 0;
+    if(!write || i*BSIZE < off || (i+1)*BSIZE > off + n)
+      iderw_start(b);
+    else
+      b->flags = B_VALID;
   }
-  fileclose(p->swapFile);
+  for(i = first; i <= last; i++)
+    iderw_wait(&swapio.buf[i]);
+
+  for(i = first; i <= last; i++){
+    b = &swapio.buf[i];
+    lo = max(off, i*BSIZE);
+    hi = min(off + n, (i+1)*BSIZE);
+    if(write){
+      memmove(b->data + lo - i*BSIZE, data + lo - off, hi - lo);
+      b->flags |= B_DIRTY;
+      iderw_start(b);
+    } else
+      memmove(data + lo - off, b->data + lo - i*BSIZE, hi - lo);
+  }
+  if(write)
+    for(i = first; i <= last; i++)
+      iderw_wait(&swapio.buf[i]);
 
-  begin_op();
-  if((dp = nameiparent(path, name)) == 0)
-  {
-    end_op();
-    return -1;
+  for(i = first; i <= last; i++)
+    releasesleep(&swapio.buf[i].lock);
+  releasesleep(&swapio.lock);
+}
+
+static int
+swaprw(struct proc *p, char *buffer, uint placeOnFile, uint size, int write)
+{
+  uint tot, n, page, off;
+  int slot;
+
+  for(tot = 0; tot < size; tot += n, placeOnFile += n, buffer += n){
+    page = placeOnFile / PGSIZE;
+    off = placeOnFile % PGSIZE;
+    n = min(size - tot, PGSIZE - off);
+    if(page >= MAX_TOTAL_PAGES)
+      return -1;
+    if((slot = p->swap_slots[page]) < 0){
+      if(!write){
+        // never written, reads back as zeroes like a file hole
+        memset(buffer, 0, n);
+        continue;
+      }
+      if((slot = swapalloc()) < 0)
+        return -1;
+      p->swap_slots[page] = slot;
+    }
+    swapslot(slot, buffer, off, n, write);
   }
+  return size;
+}
 
-  ilock(dp);
+// Compressed swap cache.
+// Whole swap pages are first offered to a pool of ZSWAPPAGES kernel
+// pages. A page of one repeated word is kept as that word alone;
+// anything else is run-length encoded by 32-bit words and stored in
+// contiguous ZCHUNK sized chunks of a single pool page. Pages that do
+// not shrink below ZMAXLEN go to the swap area. When the pool is full
+// the oldest pool pages of the storing process are written back to the
+// swap area to make room; pages of other processes are never written
+// back from under them, so a process with nothing in a full pool sends
+// its page to the swap area too. A page kept in the pool gives up its
+// swap area slot, and leaves the pool when it is swapped back in. Each
+// process maps its swap file pages to pool entries through
+// p->zswap_slots.
+
+#define ZCHUNK   256                    // pool allocation unit
+#define ZCHUNKS  (PGSIZE / ZCHUNK)      // chunks per pool page
+#define ZMAXLEN  (PGSIZE * 3 / 4)       // largest compressed page worth keeping
+#define NZENTRY  (ZSWAPPAGES * ZCHUNKS) // pool entries
+
+struct zentry {
+  int used;
+  struct proc *owner;
+  int page;       // swap page of owner
+  uint age;       // zswap.clock when stored
+  int pool;       // pool page, -1 for a same-filled page
+  int chunk;      // first chunk in the pool page
+  int nchunks;
+  uint len;       // compressed length
+  uint fill;      // the repeated word of a same-filled page
+};
 
-    // Cannot unlink "." or "..".
-  if(namecmp(name, ".") == 0 || namecmp(name, "..") == 0)
-     goto bad;
+struct {
+  struct spinlock lock;
+  char *pool[ZSWAPPAGES];
+  ushort map[ZSWAPPAGES];  // allocated chunks of each pool page
+  struct zentry entry[NZENTRY];
+  uint clock;              // stores so far, orders the entries by age
+  struct zswapstat stat;
+} zswap;
 
-  if((ip = dirlookup(dp, name, &off)) == 0)
-    goto bad;
-  ilock(ip);
+static void
+zswapinit(void)
+{
+  int i;
 
-  if(ip->nlink < 1)
-    panic("unlink: nlink < 1");
-  if(ip->type == T_DIR && !isdirempty(ip)){
-    iunlockput(ip);
-    goto bad;
+  initlock(&zswap.lock, "zswap");
+  for(i = 0; i < ZSWAPPAGES; i++)
+    if((zswap.pool[i] = kalloc()) == 0)
+      panic("zswapinit");
+  zswap.stat.pool_size = ZSWAPPAGES * PGSIZE;
+}
+
+static void
+zemit(char *dst, uint *len, void *src, uint n)
+{
+  if(dst)
+    memmove(dst + *len, src, n);
+  *len += n;
+}
+
+// Run-length encode the page at src into dst by 32-bit words.
+// A ushort header gives the count of the record; with the high bit
+// set one word follows that repeats count times, otherwise count
+// literal words follow. With dst == 0 only the length is computed.
+static uint
+zcompress(uint *src, char *dst)
+{
+  uint i, j, len;
+  ushort h;
+
+  len = 0;
+  for(i = 0; i < PGSIZE/4; i = j){
+    for(j = i+1; j < PGSIZE/4 && src[j] == src[i]; j++)
+      ;
+    if(j - i >= 2){
+      h = 0x8000 | (j - i);
+      zemit(dst, &len, &h, sizeof(h));
+      zemit(dst, &len, &src[i], 4);
+      continue;
+    }
+    for(j = i+1; j < PGSIZE/4 && !(j+1 < PGSIZE/4 && src[j] == src[j+1]); j++)
+      ;
+    h = j - i;
+    zemit(dst, &len, &h, sizeof(h));
+    zemit(dst, &len, &src[i], (j - i) * 4);
   }
+  return len;
+}
 
-  memset(&de, 0, sizeof(de));
-  if(writei(dp, (char*)&de, off, sizeof(de)) != sizeof(de))
-    panic("unlink: writei");
-  if(ip->type == T_DIR){
-    dp->nlink--;
-    iupdate(dp);
+static void
+zdecompress(char *src, uint len, uint *dst)
+{
+  uint i, n, w;
+  ushort h;
+
+  for(i = 0; i < len; ){
+    memmove(&h, src + i, sizeof(h));
+    i += sizeof(h);
+    n = h & 0x7fff;
+    if(h & 0x8000){
+      memmove(&w, src + i, 4);
+      i += 4;
+      while(n-- > 0)
+        *dst++ = w;
+    } else {
+      memmove(dst, src + i, n * 4);
+      dst += n;
+      i += n * 4;
+    }
   }
-  iunlockput(dp);
+}
 
-  ip->nlink--;
-  iupdate(ip);
-  iunlockput(ip);
+// Find n free contiguous chunks in one pool page.
+// Caller must hold zswap.lock.
+static int
+zalloc(int n, int *chunk)
+{
+  int i, c;
+  uint mask;
+
+  mask = (1 << n) - 1;
+  for(i = 0; i < ZSWAPPAGES; i++){
+    for(c = 0; c + n <= ZCHUNKS; c++){
+      if((zswap.map[i] & (mask << c)) == 0){
+        zswap.map[i] |= mask << c;
+        *chunk = c;
+        return i;
+      }
+    }
+  }
+  return -1;
+}
 
-  end_op();
+// Drop the pool copy of swap page page of p, if any.
+static void
+zswap_free(struct proc *p, int page)
+{
+  struct zentry *e;
+
+  if(p->zswap_slots[page] < 0)
+    return;
+  acquire(&zswap.lock);
+  e = &zswap.entry[p->zswap_slots[page]];
+  if(e->pool >= 0){
+    zswap.map[e->pool] &= ~(((1 << e->nchunks) - 1) << e->chunk);
+    zswap.stat.pool_bytes -= e->nchunks * ZCHUNK;
+  } else
+    zswap.stat.same_filled--;
+  zswap.stat.stored--;
+  e->used = 0;
+  release(&zswap.lock);
+  p->zswap_slots[page] = -1;
+}
 
-  return 0;
+// Keep the len bytes compressed page at buffer in a free entry.
+// Returns the entry, or -1 if the pool is full.
+// Caller must hold zswap.lock.
+static int
+zput(struct proc *p, int page, char *buffer, uint len)
+{
+  struct zentry *e;
+  int i;
 
-  bad:
-    iunlockput(dp);
-    end_op();
+  for(i = 0; i < NZENTRY && zswap.entry[i].used; i++)
+    ;
+  if(i == NZENTRY)
     return -1;
+  e = &zswap.entry[i];
+  e->pool = -1;
+  e->len = len;
+  if(len == sizeof(ushort) + 4){
+    // a single run record covers the whole page
+    e->fill = ((uint*)buffer)[0];
+    e->nchunks = 0;
+    zswap.stat.same_filled++;
+  } else {
+    e->nchunks = (len + ZCHUNK - 1) / ZCHUNK;
+    if((e->pool = zalloc(e->nchunks, &e->chunk)) < 0)
+      return -1;
+    zcompress((uint*)buffer, zswap.pool[e->pool] + e->chunk * ZCHUNK);
+    zswap.stat.pool_bytes += e->nchunks * ZCHUNK;
+  }
+  e->used = 1;
+  e->owner = p;
+  e->page = page;
+  e->age = zswap.clock++;
+  return i;
+}
 
+// The swap page of p whose pool copy is oldest, or -1.
+// Caller must hold zswap.lock.
+static int
+zoldest(struct proc *p)
+{
+  struct zentry *e, *old;
+
+  old = 0;
+  for(e = zswap.entry; e < &zswap.entry[NZENTRY]; e++)
+    if(e->used && e->owner == p && (old == 0 || (int)(e->age - old->age) < 0))
+      old = e;
+  return old ? old->page : -1;
 }
 
+static int zswap_writeback(struct proc*, int);
 
-//return 0 on success
-int
-createSwapFile(struct proc* p)
+// Try to keep the PGSIZE bytes at buffer as swap page page of p
+// in the pool, writing back older pages of p while it is full.
+// Returns 0 on success, -1 if it has to go to disk.
+static int
+zswap_store(struct proc *p, int page, char *buffer)
 {
+  uint len;
+  int i, old;
+
+  len = zcompress((uint*)buffer, 0);
+  acquire(&zswap.lock);
+  if(len > ZMAXLEN)
+    goto reject;
+  while((i = zput(p, page, buffer, len)) < 0){
+    if((old = zoldest(p)) < 0)
+      goto reject;
+    release(&zswap.lock);
+    if(zswap_writeback(p, old) < 0)
+      return -1;
+    acquire(&zswap.lock);
+    zswap.stat.writebacks++;
+  }
+  zswap.stat.stored++;
+  zswap.stat.stores++;
+  zswap.stat.orig_bytes += PGSIZE;
+  zswap.stat.comp_bytes += len;
+  release(&zswap.lock);
+  p->zswap_slots[page] = i;
+  if(p->swap_slots[page] >= 0){
+    swapfree(p->swap_slots[page]);
+    p->swap_slots[page] = -1;
+  }
+  return 0;
 
-  char path[DIGITS];
-  memmove(path,"/.swap", 6);
-  itoa(p->pid, path+ 6);
+reject:
+  zswap.stat.rejects++;
+  release(&zswap.lock);
+  return -1;
+}
 
+// Copy n bytes at offset off of the pool copy of swap page page of p
+// to buffer.
+static int
+zswap_load(struct proc *p, int page, char *buffer, uint off, uint n)
+{
+  struct zentry *e;
+  uint *tmp;
+  int i;
 
-    begin_op();
+  if(off == 0 && n == PGSIZE)
+    tmp = (uint*)buffer;
+  else if((tmp = (uint*)kalloc()) == 0)
+    return -1;
+  acquire(&zswap.lock);
+  e = &zswap.entry[p->zswap_slots[page]];
+  if(e->pool < 0){
+    for(i = 0; i < PGSIZE/4; i++)
+      tmp[i] = e->fill;
+  } else
+    zdecompress(zswap.pool[e->pool] + e->chunk * ZCHUNK, e->len, tmp);
+  release(&zswap.lock);
+  if(tmp != (uint*)buffer){
+    memmove(buffer, (char*)tmp + off, n);
+    kfree((char*)tmp);
+  }
+  return 0;
+}
+
+// Move the pool copy of swap page page of p to the swap area.
+static int
+zswap_writeback(struct proc *p, int page)
+{
+  char *tmp;
+  int r;
 
-    struct inode * in = create(path, T_FILE, 0, 0);
+  if((tmp = kalloc()) == 0)
+    return -1;
+  zswap_load(p, page, tmp, 0, PGSIZE);
+  r = swaprw(p, tmp, page * PGSIZE, PGSIZE, 1);
+  kfree(tmp);
+  zswap_free(p, page);
+  return r;
+}
 
-  iunlock(in);
-  p->swapFile = filealloc();
-  if (p->swapFile == 0)
-    panic("no slot for files on /store");
+void
+zswap_getstat(struct zswapstat *st)
+{
+  acquire(&zswap.lock);
+  *st = zswap.stat;
+  release(&zswap.lock);
+}
 
-  p->swapFile->ip = in;
-  p->swapFile->type = FD_INODE;
-  p->swapFile->off = 0;
-  p->swapFile->readable = O_WRONLY;
-  p->swapFile->writable = O_RDWR;
-    end_op();
+//remove swap file of proc p;
+int
+removeSwapFile(struct proc* p)
+{
+  int i;
 
-    return 0;
+  for(i = 0; i < MAX_TOTAL_PAGES; i++){
+    zswap_free(p, i);
+    if(p->swap_slots[i] >= 0)
+      swapfree(p->swap_slots[i]);
+    p->swap_slots[i] = -1;
+  }
+  return 0;
+}
+
+//return 0 on success
+int
+createSwapFile(struct proc* p)
+{
+  int i;
+
+  for(i = 0; i < MAX_TOTAL_PAGES; i++){
+    p->swap_slots[i] = -1;
+    p->zswap_slots[i] = -1;
+  }
+  return 0;
 }
 
 //return as sys_write (-1 when error)
 int
 writeToSwapFile(struct proc * p, char* buffer, uint placeOnFile, uint size)
 {
-  p->swapFile->off = placeOnFile;
-
-  return filewrite(p->swapFile, buffer, size);
+  unsigned long long start = rdtsc();
+  int r = swapwrite(p, buffer, placeOnFile, size);
 
+  p->swapio_cycles += rdtsc() - start;
+  return r;
 }
 
 //return as sys_read (-1 when error)
 int
 readFromSwapFile(struct proc * p, char* buffer, uint placeOnFile, uint size)
 {
-  p->swapFile->off = placeOnFile;
+  unsigned long long start = rdtsc();
+  int r = swapread(p, buffer, placeOnFile, size, 1);
+
+  p->swapio_cycles += rdtsc() - start;
+  return r;
+}
+
+static int
+swapwrite(struct proc * p, char* buffer, uint placeOnFile, uint size)
+{
+  uint tot, n, page;
 
-  return fileread(p->swapFile, buffer,  size);
+  for(tot = 0; tot < size; tot += n, placeOnFile += n, buffer += n){
+    page = placeOnFile / PGSIZE;
+    n = min(size - tot, PGSIZE - placeOnFile % PGSIZE);
+    if(page >= MAX_TOTAL_PAGES)
+      return -1;
+    if(n == PGSIZE){
+      zswap_free(p, page);
+      if(zswap_store(p, page, buffer) == 0)
+        continue;
+    } else if(p->zswap_slots[page] >= 0 && zswap_writeback(p, page) < 0)
+      return -1;
+    if(swaprw(p, buffer, placeOnFile, n, 1) < 0)
+      return -1;
+  }
+  return size;
 }
 
+//copy the swap file of src to dst, for fork (-1 when error)
+int
+copySwapFile(struct proc* src, struct proc* dst)
+{
+  char *buffer;
+  int i, r;
+
+  if((buffer = kalloc()) == 0)
+    return -1;
+  r = 0;
+  for(i = 0; i < MAX_TOTAL_PAGES && r == 0; i++){
+    if(src->swap_slots[i] < 0 && src->zswap_slots[i] < 0)
+      continue;
+    if(swapread(src, buffer, i*PGSIZE, PGSIZE, 0) < 0 ||
+       writeToSwapFile(dst, buffer, i*PGSIZE, PGSIZE) < 0)
+      r = -1;
+  }
+  kfree(buffer);
+  return r;
+}
 
+// Read swap file pages. A swapin read brings the pages back
+// into memory, so it is counted in the zswap stats and drops
+// the pool copy of each whole page; a fork copy leaves both.
+static int
+swapread(struct proc * p, char* buffer, uint placeOnFile, uint size, int swapin)
+{
+  uint tot, n, page;
 
+  for(tot = 0; tot < size; tot += n, placeOnFile += n, buffer += n){
+    page = placeOnFile / PGSIZE;
+    n = min(size - tot, PGSIZE - placeOnFile % PGSIZE);
+    if(page >= MAX_TOTAL_PAGES)
+      return -1;
+    if(swapin){
+      acquire(&zswap.lock);
+      zswap.stat.loads++;
+      if(p->zswap_slots[page] >= 0)
+        zswap.stat.hits++;
+      release(&zswap.lock);
+    }
+    if(p->zswap_slots[page] >= 0){
+      if(zswap_load(p, page, buffer, placeOnFile % PGSIZE, n) < 0)
+        return -1;
+      if(swapin && n == PGSIZE)
+        zswap_free(p, page);
+    } else if(swaprw(p, buffer, placeOnFile, n, 0) < 0)
+      return -1;
+  }
+  return size;
+}
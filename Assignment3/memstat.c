@@ -0,0 +1,82 @@
+// Report paging statistics.
+//   memstat -p pid...      current statistics of running processes
+//   memstat cmd [args...]  run cmd and report its final statistics
+
+#include "param.h"
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "memstat.h"
+
+#ifdef LIFO
+#define POLICY "LIFO"
+#elif defined(SCFIFO)
+#define POLICY "SCFIFO"
+#else
+#define POLICY "NONE"
+#endif
+
+void
+print_memstat(struct memstat *st)
+{
+  int i;
+
+  printf(1, "pid %d%s: faults %d (major %d, minor %d) paged out %d\n",
+         st->pid, st->exited ? " (exited)" : "", st->page_faults,
+         st->major_faults, st->minor_faults, st->paged_out);
+  printf(1, "  swap_page_IN %d kcycles", st->swapin_kcycles);
+  if(st->major_faults > 0)
+    printf(1, " (%d per major fault)", st->swapin_kcycles / st->major_faults);
+  printf(1, ", swap_page_OUT %d kcycles", st->swapout_kcycles);
+  if(st->paged_out > 0)
+    printf(1, " (%d per eviction)", st->swapout_kcycles / st->paged_out);
+  printf(1, ", swap I/O %d kcycles\n", st->swapio_kcycles);
+  printf(1, "  %s victims: %d refaulted", POLICY, st->refaults);
+  if(st->paged_out > 0)
+    printf(1, ", hit rate %d%%", (st->paged_out - st->refaults) * 100 / st->paged_out);
+  printf(1, "\n  rss %d max %d (limit %d), every %d ticks:", st->rss, st->rss_max,
+         MAX_PSYC_PAGES, RSS_PERIOD);
+  for(i = 0; i < st->nsamples; i++)
+    printf(1, " %d", st->rss_samples[i]);
+  printf(1, "\n");
+}
+
+int
+main(int argc, char *argv[])
+{
+  struct memstat st;
+  int i, pid;
+
+  if(argc < 2){
+    printf(2, "usage: memstat -p pid... | memstat cmd [args...]\n");
+    exit();
+  }
+
+  if(strcmp(argv[1], "-p") == 0){
+    for(i = 2; i < argc; i++){
+      if(get_memstat(atoi(argv[i]), &st) < 0)
+        printf(2, "memstat: no process %s\n", argv[i]);
+      else
+        print_memstat(&st);
+    }
+    exit();
+  }
+
+  pid = fork();
+  if(pid < 0){
+    printf(2, "memstat: fork failed\n");
+    exit();
+  }
+  if(pid == 0){
+    exec(argv[1], argv+1);
+    printf(2, "memstat: exec %s failed\n", argv[1]);
+    exit();
+  }
+  // A zombie still reports, so poll until the child has exited
+  // and read its final counters before reaping it.
+  while(get_memstat(pid, &st) == 0 && !st.exited)
+    sleep(1);
+  print_memstat(&st);
+  wait();
+  exit();
+}
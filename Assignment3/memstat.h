@@ -0,0 +1,19 @@
+// Per-process paging statistics, filled in by get_memstat().
+// Needs param.h for RSS_SAMPLES.
+
+struct memstat {
+  int pid;
+  int exited;             // process is a zombie, counters are final
+  uint page_faults;       // all page faults
+  uint major_faults;      // faults that read a page back from swap
+  uint minor_faults;      // faults served without swap I/O (demand-zero)
+  uint paged_out;         // pages evicted
+  uint refaults;          // major faults on one of the last MAX_PSYC_PAGES victims
+  uint swapin_kcycles;    // 1024-cycle units spent in swap_page_IN, including evictions
+  uint swapout_kcycles;   // 1024-cycle units spent in swap_page_OUT
+  uint swapio_kcycles;    // 1024-cycle units spent in swap file reads and writes
+  uint rss;               // resident pages now
+  uint rss_max;           // most resident pages seen
+  uint nsamples;          // valid entries of rss_samples
+  uint rss_samples[RSS_SAMPLES]; // resident pages every RSS_PERIOD ticks, oldest first
+};
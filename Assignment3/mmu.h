@@ -144,6 +144,9 @@ struct segdesc {
 #define PTE_MBZ         0x180   // Bits must be zero
 #define PTE_PG          0x200   // Paged out to secondary storage 
 
+// Page fault error code bits (tf->err)
+#define FEC_WR          0x002   // Fault was caused by a write
+
 
 // Address in page table or page directory entry
 #define PTE_ADDR(pte)   ((uint)(pte) & ~0xFFF)
@@ -1,10 +1,13 @@
 #include "types.h"
 #include "stat.h"
 #include "user.h"
+#include "param.h"
+#include "zswap.h"
 
 #define NUM_OF_TESTS 3
 #define NUM_OF_PAGES_TO_ALLOCATE 10
 #define PGSIZE 4096
+#define SEQ_SCAN_PAGES 24
  //Task 1: Protecting Pages
 void Protecting_Pages_pmalloc_test(void);
 void Protecting_Pages_protect_page_test(void);
@@ -20,6 +23,7 @@ void replacement_schemes_test();
 void Replacement_Schemes_LIFO_test();
 void Replacement_Schemes_SCFIFO_test();
 void Replacement_Schemes_NONE_test();
+void Sequential_Scan_test();
 char *echoargv[] = { "echo", "NONE", "TEST", "PASSED", 0 };
 
 
@@ -57,6 +61,12 @@ replacement_schemes_test()
             printf(1,"*****end SCFIFO_test!*****\n\n");
         #endif
 
+        #ifndef NONE
+            printf(1,"*****start Sequential_Scan_test!*****\n\n");
+            Sequential_Scan_test();
+            printf(1,"*****end Sequential_Scan_test!*****\n\n");
+        #endif
+
         #ifdef NONE
             printf(1,"*****start NONE_test!*****\n\n");
             Replacement_Schemes_NONE_test(),
@@ -159,6 +169,8 @@ void fill_physical_memory(char **arr)
 	// Allocate all remaining 12 physical pages
 	for (int i = 0; i < 12; ++i) {
 		arr[i] = sbrk(PGSIZE);
+		// sbrk only reserves the page, touch it to get a frame
+		arr[i][0] = 0;
 		printf(1, "arr[%d]=0x%x\n", i, arr[i]);
 	}
 	printf(1, "all physical pages taken.\nPress ctrl+P for enhanced process details, else enter.\n");
@@ -174,11 +186,13 @@ Replacement_Schemes_LIFO_test()
     fill_physical_memory(arr);
    	gets(input, 10);
 	arr[12] = sbrk(PGSIZE);
+	arr[12][0] = 0;
 	printf(1, "arr[12]=0x%x\n", arr[12]);
 	printf(1, "Called sbrk(PGSIZE).one page in swap file.\nPress ctrl+P for enhanced process details, else enter.\n");
 	gets(input, 10);
 	//This would cause page 2 to move to the swap file
 	arr[13] = sbrk(PGSIZE);
+	arr[13][0] = 0;
 	printf(1, "arr[13]=0x%x\n", arr[13]);
 	printf(1, "Called sbrk(PGSIZE).two pages in swap file.\nPPress ctrl+P for enhanced process details, else enter.\n");
 	gets(input, 10);
@@ -218,13 +232,15 @@ Replacement_Schemes_SCFIFO_test()
 	gets(input, 10);
 	//page 1 will be swapped out.
 	arr[12] = sbrk(PGSIZE);
+	arr[12][0] = 0;
 	printf(1, "arr[12]=0x%x\n", arr[12]);
-	printf(1, "Called sbrk(PGSIZE) for the 13th time, no page fault should occur and one page in swap file.\nPress ctrl+P for enhanced process details, else enter.\n");
+	printf(1, "Called sbrk(PGSIZE) for the 13th time and touched, one demand-zero fault should occur and one page in swap file.\nPress ctrl+P for enhanced process details, else enter.\n");
 	gets(input, 10);
 	//page 3 will be swapped out. pages 1 and 3 are in swapfile.
 	arr[13] = sbrk(PGSIZE);
+	arr[13][0] = 0;
 	printf(1, "arr[13]=0x%x\n", arr[13]);
-	printf(1, "Called sbrk(PGSIZE) for the 14th time, no page fault should occur and two pages in swap file.\nPress ctrl+P for enhanced process details, else enter.\n");
+	printf(1, "Called sbrk(PGSIZE) for the 14th time and touched, one demand-zero fault should occur and two pages in swap file.\nPress ctrl+P for enhanced process details, else enter.\n");
 	gets(input, 10);
 	//Access page 3, causing a PGFLT. It would swapped with page 4. 
     //Page 4 is accessed next, so another PGFLT is invoked and this process repeats a total of 5 times.
@@ -284,6 +300,60 @@ Replacement_Schemes_NONE_test()
 	}
 }
 
+// Scan pages that live mostly in the swap file front to back, so the
+// fault-around path can bring several of them in per page fault.
+// Scan more pages than fit in memory, so every round swaps pages
+// back in in order. Fault-around must bring them in about
+// FAULT_AROUND_WINDOW at a time: after the first round, which
+// ramps the window up, fail if there are more than twice the
+// faults that would take.
+void
+Sequential_Scan_test()
+{
+    int i, j, round;
+    int start_ticks, faults, paged_out;
+    char *arr[SEQ_SCAN_PAGES];
+    struct zswapstat st;
+
+    for (i = 0; i < SEQ_SCAN_PAGES; ++i) {
+        arr[i] = sbrk(PGSIZE);
+        arr[i][0] = i;
+    }
+    faults = paged_out = 0;
+    for (round = 0; round < 3; round++) {
+        if (round == 1 && zswap_stat(&st) == 0) {
+            faults = st.page_faults;
+            paged_out = st.paged_out;
+        }
+        start_ticks = uptime();
+        for (i = 0; i < SEQ_SCAN_PAGES; i++) {
+            for (j = 0; j < PGSIZE; j++)
+                arr[i][j] = 's';
+        }
+        printf(1, "sequential scan %d of %d pages took %d ticks\n", round, SEQ_SCAN_PAGES, uptime() - start_ticks);
+    }
+    if (zswap_stat(&st) < 0) {
+        failed_test("Sequential_Scan - zswap_stat");
+        goto done;
+    }
+    faults = st.page_faults - faults;
+    paged_out = st.paged_out - paged_out;
+    printf(1, "last 2 scans: %d page faults, %d pages paged out\n", faults, paged_out);
+    printf(1, "zswap: %d stored (%d same-filled), %d hits of %d loads, %d rejects, %d written back, %d of %d pool bytes used\n",
+           st.stored, st.same_filled, st.hits, st.loads, st.rejects, st.writebacks, st.pool_bytes, st.pool_size);
+    if (st.comp_bytes > 0)
+        printf(1, "zswap: compression ratio %d:1\n", st.orig_bytes / st.comp_bytes);
+    // as many pages come back in as go out
+    if (paged_out == 0)
+        failed_test("Sequential_Scan - no paging");
+    else if (FAULT_AROUND_WINDOW > 1 && faults * FAULT_AROUND_WINDOW > 2 * paged_out)
+        failed_test("Sequential_Scan - fault-around");
+    else
+        printf(1, "\ntest ended!\n\n");
+done:
+    sbrk(-SEQ_SCAN_PAGES * PGSIZE);
+}
+
 void 
 failed_test(char* error)
 {
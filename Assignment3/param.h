@@ -11,5 +11,11 @@
 #define LOGSIZE      (MAXOPBLOCKS*3)  // max data blocks in on-disk log
 #define NBUF         (MAXOPBLOCKS*3)  // size of disk block cache
 #define FSSIZE       1000  // size of file system in blocks
+#define NSWAPPAGES   1024  // pages in the raw swap area after the file system
+#define SWAPSIZE     (NSWAPPAGES*8)  // size of swap area in blocks
+#define ZSWAPPAGES   64  // kernel pages of compressed swap cache (0 disables it)
+#define RSS_SAMPLES  16  // resident set size history kept per process
+#define RSS_PERIOD   10  // ticks between resident set size samples
 #define MAX_TOTAL_PAGES 32 // max size of pages for process
 #define MAX_PSYC_PAGES 16 // max size of pages for proc in pysical memory
+#define FAULT_AROUND_WINDOW 4 // max swapped pages read in by one sequential fault (1 disables)
@@ -102,6 +102,8 @@ piperead(struct pipe *p, char *addr, int n)
 {
   int i;
 
+  // at most PIPESIZE bytes are stored to addr under p->lock
+  prefault_uvm(addr, n < PIPESIZE ? n : PIPESIZE);
   acquire(&p->lock);
   while(p->nread == p->nwrite && p->writeopen){  //DOC: pipe-empty
     if(myproc()->killed){
@@ -6,6 +6,7 @@
 #include "x86.h"
 #include "proc.h"
 #include "spinlock.h"
+#include "memstat.h"
 
 struct {
   struct spinlock lock;
@@ -81,6 +82,7 @@ allocproc(void)
 {
   struct proc *p;
   char *sp;
+  int i;
 
   acquire(&ptable.lock);
 
@@ -118,6 +120,21 @@ found:
 
   p->page_faults_counter = 0;
   p->paged_out_counter = 0;
+  p->last_fault_va = 0;
+  p->fault_window = 1;
+  p->major_faults = 0;
+  p->minor_faults = 0;
+  p->refaults = 0;
+  p->swapin_cycles = 0;
+  p->swapout_cycles = 0;
+  p->swapio_cycles = 0;
+  // KERNBASE is never a user page, so empty slots match no fault
+  for(i = 0; i < MAX_PSYC_PAGES; i++)
+    p->victims[i] = KERNBASE;
+  p->next_victim = 0;
+  p->rss_max = 0;
+  p->nsamples = 0;
+  p->last_sample_tick = 0;
   // Leave room for trap frame.
   sp -= sizeof *p->tf;
   p->tf = (struct trapframe*)sp;
@@ -244,9 +261,11 @@ growproc(int n)
 
   sz = curproc->sz;
   if(n > 0){
-    if((sz = allocuvm(curproc->pgdir, sz, sz + n)) == 0)
+    // Only reserve the address space, lazy_page_fault backs
+    // each page on its first touch.
+    if(sz + n >= KERNBASE || sz + n < sz)
       return -1;
-    
+    sz += n;
   } else if(n < 0){
     if((sz = deallocuvm(curproc->pgdir, sz, sz + n)) == 0)
       return -1;
@@ -266,15 +285,8 @@ copy_page_data(struct page_data* src, struct page_data* dst){
 
 void
 copy_swapfile(struct proc *p_src, struct proc *p_dst){
-  uint fileOffset = 0;
-  char buffer[PGSIZE];
-  int bytes;
-
-  while ((bytes = readFromSwapFile(p_src, buffer, fileOffset, PGSIZE))>0){ 
-    if(writeToSwapFile(p_dst,buffer, fileOffset, bytes)<0)
-      panic("fork: error writeToSwapFile"); 
-    fileOffset+=bytes;
-  }
+  if(copySwapFile(p_src, p_dst) < 0)
+    panic("fork: error copySwapFile");
 }
 
 void copy_meta_data(struct page_data* src, struct page_data* dst){
@@ -736,3 +748,57 @@ procdump(void)
   }
   print_system_info();
 }
+
+// Record the resident set size of p every RSS_PERIOD ticks.
+// Called from the timer interrupt for the running process.
+void
+sample_rss(struct proc *p)
+{
+  uint rss;
+
+  if(p->nsamples > 0 && ticks - p->last_sample_tick < RSS_PERIOD)
+    return;
+  p->last_sample_tick = ticks;
+  rss = get_pages_count(p->pages_IN);
+  if(rss > p->rss_max)
+    p->rss_max = rss;
+  p->rss_samples[p->nsamples % RSS_SAMPLES] = rss;
+  p->nsamples++;
+}
+
+// Copy the paging statistics of process pid to st.
+// Zombies still report, so a parent can read the final
+// counters of a child before it waits for it.
+int
+get_memstat(int pid, struct memstat *st)
+{
+  struct proc *p;
+  uint i, first;
+
+  acquire(&ptable.lock);
+  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
+    if(p->pid != pid || p->state == UNUSED || p->state == EMBRYO)
+      continue;
+    memset(st, 0, sizeof(*st));
+    st->pid = p->pid;
+    st->exited = p->state == ZOMBIE;
+    st->page_faults = p->page_faults_counter;
+    st->major_faults = p->major_faults;
+    st->minor_faults = p->minor_faults;
+    st->paged_out = p->paged_out_counter;
+    st->refaults = p->refaults;
+    st->swapin_kcycles = p->swapin_cycles >> 10;
+    st->swapout_kcycles = p->swapout_cycles >> 10;
+    st->swapio_kcycles = p->swapio_cycles >> 10;
+    st->rss = get_pages_count(p->pages_IN);
+    st->rss_max = p->rss_max > st->rss ? p->rss_max : st->rss;
+    st->nsamples = p->nsamples < RSS_SAMPLES ? p->nsamples : RSS_SAMPLES;
+    first = p->nsamples - st->nsamples;
+    for(i = 0; i < st->nsamples; i++)
+      st->rss_samples[i] = p->rss_samples[(first + i) % RSS_SAMPLES];
+    release(&ptable.lock);
+    return 0;
+  }
+  release(&ptable.lock);
+  return -1;
+}
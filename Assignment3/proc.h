@@ -66,7 +66,8 @@ struct proc {
   char name[16];               // Process name (debugging)
 
   //Swap file. must initiate with create swap file
-  struct file *swapFile;      //page file
+  int swap_slots[MAX_TOTAL_PAGES]; // swap area slot of each swap file page, -1 if none
+  int zswap_slots[MAX_TOTAL_PAGES]; // compressed swap cache entry of each page, -1 if none
   struct page_data pages_OUT[MAX_PSYC_PAGES]; // meta data for OUT pages
   struct page_data pages_IN[MAX_PSYC_PAGES];  // meta data for IN pages
   struct temp temp_page; //special case of swap file
@@ -74,6 +75,20 @@ struct proc {
   int min_swapfile_offset; // indicate the minimum free offset value for swapfile
   uint page_faults_counter;
   uint paged_out_counter;
+  uint major_faults;  // faults that read a page back from swap
+  uint minor_faults;  // demand-zero faults
+  uint refaults;      // major faults on a recent victim
+  unsigned long long swapin_cycles;
+  unsigned long long swapout_cycles;
+  unsigned long long swapio_cycles;
+  uint victims[MAX_PSYC_PAGES]; // last evicted pages, for refault detection, KERNBASE if empty
+  int next_victim;
+  uint rss_max;
+  uint rss_samples[RSS_SAMPLES]; // ring of resident set size samples
+  uint nsamples;
+  uint last_sample_tick;
+  uint last_fault_va; // page of the last swap fault, for the stride detector
+  int fault_window;  // pages to bring in on the next sequential swap fault
 };
 
 // Process memory is laid out contiguously, low addresses first:
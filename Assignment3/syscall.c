@@ -107,6 +107,8 @@ extern int sys_yield(void);
 extern int sys_add_flag_to_pte(void);
 extern int sys_remove_flag_from_pte(void);
 extern int sys_check_flag_on_pte(void);
+extern int sys_zswap_stat(void);
+extern int sys_get_memstat(void);
 
 
 static int (*syscalls[])(void) = {
@@ -135,6 +137,8 @@ static int (*syscalls[])(void) = {
 [SYS_add_flag_to_pte]         sys_add_flag_to_pte,
 [SYS_remove_flag_from_pte]    sys_remove_flag_from_pte,
 [SYS_check_flag_on_pte]       sys_check_flag_on_pte,
+[SYS_zswap_stat]              sys_zswap_stat,
+[SYS_get_memstat]             sys_get_memstat,
 
 };
 
@@ -23,4 +23,6 @@
 #define SYS_yield  22
 #define SYS_add_flag_to_pte  23
 #define SYS_remove_flag_from_pte  24
-#define SYS_check_flag_on_pte  25
\ No newline at end of file
+#define SYS_check_flag_on_pte  25
+#define SYS_zswap_stat  26
+#define SYS_get_memstat  27
\ No newline at end of file
@@ -6,6 +6,8 @@
 #include "memlayout.h"
 #include "mmu.h"
 #include "proc.h"
+#include "zswap.h"
+#include "memstat.h"
 
 
 int sys_yield(void)
@@ -128,4 +130,38 @@ sys_check_flag_on_pte(void)
   if(argint(1, (int*) &va)  < 0 || argint(0, &flag) < 0)
     return -1;
   return check_flag_on_pte((uint)flag, va); 
-}
\ No newline at end of file
+}
+
+// fill in compressed swap cache statistics and the
+// paging counters of the calling process.
+int
+sys_zswap_stat(void)
+{
+  struct zswapstat *st, kst;
+
+  if(argptr(0, (char**)&st, sizeof(*st)) < 0)
+    return -1;
+  // fill a kernel copy under zswap.lock, the copy to user
+  // memory may fault
+  zswap_getstat(&kst);
+  kst.page_faults = myproc()->page_faults_counter;
+  kst.paged_out = myproc()->paged_out_counter;
+  *st = kst;
+  return 0;
+}
+
+// fill in the paging statistics of process pid.
+int
+sys_get_memstat(void)
+{
+  int pid;
+  struct memstat *st, kst;
+
+  if(argint(0, &pid) < 0 || argptr(1, (char**)&st, sizeof(*st)) < 0)
+    return -1;
+  // fill a kernel copy, user memory may fault while ptable.lock is held
+  if(get_memstat(pid, &kst) < 0)
+    return -1;
+  *st = kst;
+  return 0;
+}
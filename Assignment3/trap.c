@@ -54,6 +54,8 @@ trap(struct trapframe *tf)
       wakeup(&ticks);
       release(&tickslock);
     }
+    if(myproc() && myproc()->state == RUNNING)
+      sample_rss(myproc());
     lapiceoi();
     break;
   case T_IRQ0 + IRQ_IDE:
@@ -81,13 +83,19 @@ trap(struct trapframe *tf)
   case T_PGFLT:
     // cprintf("got T_PGFLT proc pid: %d\n before: %d", myproc()->pid, myproc()->page_faults_counter);
     myproc()->page_faults_counter=myproc()->page_faults_counter+1;
+    // sbrk only reserves address space, back the page on first touch
+    if(lazy_page_fault((void*)rcr2(), tf->err & FEC_WR) == 0){
+      myproc()->minor_faults++;
+      break;
+    }
     // check pte for PTE_W flag
     if((check_flag_on_pte(PTE_W, (void*)rcr2()) != 0)){
       tf->trapno = T_GPFLT;
     } 
     #ifndef NONE    
       if(check_flag_on_pte(PTE_PG, (void*)rcr2()) == 0){
-        swap_page_IN((void*)rcr2(),myproc()->pgdir);
+        myproc()->major_faults++;
+        swap_page_IN_around((void*)rcr2(),myproc()->pgdir);
         break;
       }
     #endif
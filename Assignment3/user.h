@@ -1,5 +1,7 @@
 struct stat;
 struct rtcdate;
+struct zswapstat;
+struct memstat;
 
 // system calls
 int fork(void);
@@ -27,6 +29,8 @@ int yield(void);
 int add_flag_to_pte(uint, void*);
 int remove_flag_from_pte(uint, void*);
 int check_flag_on_pte(uint, void*);
+int zswap_stat(struct zswapstat*);
+int get_memstat(int, struct memstat*);
 
 
 
@@ -9,6 +9,7 @@
 
 extern char data[];  // defined by kernel.ld
 pde_t *kpgdir;  // for use in scheduler()
+char *zeropage; // shared read-only page of zeroes for untouched sbrk memory
 
 // Set up CPU's kernel segment descriptors.
 // Run once on entry on each CPU.
@@ -142,6 +143,9 @@ void
 kvmalloc(void)
 {
   kpgdir = setupkvm();
+  if((zeropage = kalloc()) == 0)
+    panic("kvmalloc: zeropage");
+  memset(zeropage, 0, PGSIZE);
   switchkvm();
 }
 
@@ -325,6 +329,109 @@ allocuvm(pde_t *pgdir, uint oldsz, uint newsz)
   return allocuvm_paging_swapout(pgdir, oldsz, newsz);  
 }
 
+// Does pte map the shared zero page?
+static int
+is_zeropage(pte_t *pte)
+{
+  return pte != 0 && (*pte & PTE_P) && PTE_ADDR(*pte) == V2P(zeropage);
+}
+
+#ifndef NONE
+// Does the kernel hold a spinlock? Then it must not sleep.
+static int
+holding_spinlock(void)
+{
+  int locked;
+
+  pushcli();
+  locked = mycpu()->ncli > 1;
+  popcli();
+  return locked;
+}
+#endif
+
+// Back a page that sbrk reserved but never touched. A read maps the
+// shared zero page, a write (also to the zero page) allocates a
+// private zeroed frame, swapping out a victim if the process is at
+// MAX_PSYC_PAGES. Returns 0 if handled, -1 if va is not such a page
+// or the swap out would have to sleep while the faulting kernel code
+// holds a spinlock (prefault_uvm() avoids that for the copies to user
+// memory made under one).
+int
+lazy_page_fault(void *va, int write)
+{
+  struct proc *p = myproc();
+  pde_t *pgdir = p->pgdir;
+  char *a = (char*)PGROUNDDOWN((uint)va);
+  char *mem;
+  pte_t *pte;
+
+  if((uint)va >= p->sz)
+    return -1;
+  pte = walkpgdir(pgdir, a, 0);
+  if(pte != 0 && *pte != 0 && !is_zeropage(pte))
+    return -1;
+  if(!write){
+    if(is_zeropage(pte))
+      return -1;
+    if(mappages(pgdir, a, PGSIZE, V2P(zeropage), PTE_U) < 0)
+      return -1;
+    return 0;
+  }
+  #ifndef NONE
+    if(get_pages_count(p->pages_IN) >= MAX_PSYC_PAGES){
+      // no room in pages_OUT means the process is at MAX_TOTAL_PAGES
+      if(get_pages_count(p->pages_OUT) >= MAX_PSYC_PAGES)
+        return -1;
+      if(holding_spinlock())
+        return -1;
+      if(pte != 0)
+        *pte = 0;
+      swap_page_OUT(pgdir);
+    }
+  #endif
+  if(pte != 0)
+    *pte = 0;
+  if((mem = kalloc()) == 0){
+    cprintf("lazy_page_fault out of memory\n");
+    return -1;
+  }
+  memset(mem, 0, PGSIZE);
+  if(mappages(pgdir, a, PGSIZE, V2P(mem), PTE_W|PTE_U) < 0){
+    kfree(mem);
+    return -1;
+  }
+  #ifndef NONE
+    long long time_counter = add_to_upages(p->pages_IN, a, p->time_load_counter);
+    if(time_counter < 0)
+      panic("lazy_page_fault: add_to_upages failed");
+    p->time_load_counter = time_counter;
+  #endif
+  lcr3(V2P(pgdir));
+  return 0;
+}
+
+// Back every untouched page of the user range [va, va+n) with a
+// private frame, so that kernel code storing to it while holding
+// a spinlock (piperead, consoleread) does not take a fault that
+// would have to swap out and sleep. Loads under a spinlock need
+// nothing: a read fault only maps the shared zero page.
+void
+prefault_uvm(char *va, uint n)
+{
+  char *a, *last;
+
+  if(n == 0)
+    return;
+  a = (char*)PGROUNDDOWN((uint)va);
+  last = (char*)PGROUNDDOWN((uint)va + n - 1);
+  for(;; a += PGSIZE){
+    lazy_page_fault(a, 1);
+    if(a == last)
+      break;
+  }
+}
+
 int
 deallocuvm_paging_swapout(pde_t *pgdir, uint oldsz, uint newsz)
 {
@@ -343,6 +450,8 @@ deallocuvm_paging_swapout(pde_t *pgdir, uint oldsz, uint newsz)
     pte = walkpgdir(pgdir, (char*)a, 0);
     if(!pte)
       a = PGADDR(PDX(a) + 1, 0, 0) - PGSIZE;
+    else if(is_zeropage(pte))
+      *pte = 0;
     else if((*pte & PTE_P) != 0){
       found_indicator = 1;
       pa = PTE_ADDR(*pte);
@@ -389,6 +498,8 @@ deallocuvm_NONE(pde_t *pgdir, uint oldsz, uint newsz)
     pte = walkpgdir(pgdir, (char*)a, 0);
     if(!pte)
       a = PGADDR(PDX(a) + 1, 0, 0) - PGSIZE;
+    else if(is_zeropage(pte))
+      *pte = 0;
     else if((*pte & PTE_P) != 0){
       pa = PTE_ADDR(*pte);
       if(pa == 0)
@@ -459,8 +570,14 @@ copyuvm_NONE(pde_t *pgdir, uint sz)
   if((d = setupkvm()) == 0)
     return 0;
   for(i = 0; i < sz; i += PGSIZE){
-    if((pte = walkpgdir(pgdir, (void *) i, 0)) == 0)
-      panic("copyuvm: pte should exist");
+    // sbrk'd pages that were never touched have nothing to copy
+    if((pte = walkpgdir(pgdir, (void *) i, 0)) == 0 || *pte == 0)
+      continue;
+    if(is_zeropage(pte)){
+      if(mappages(d, (void*)i, PGSIZE, V2P(zeropage), PTE_FLAGS(*pte)) < 0)
+        goto bad;
+      continue;
+    }
     if(!(*pte & PTE_P))
       panic("copyuvm: page not present");
     pa = PTE_ADDR(*pte);
@@ -493,8 +610,14 @@ copyuvm_paging_swapout(pde_t *pgdir, uint sz)
   if((d = setupkvm()) == 0)
     return 0;
   for(i = 0; i < sz; i += PGSIZE){
-    if((pte = walkpgdir(pgdir, (void *) i, 0)) == 0)
-      panic("copyuvm: pte should exist");
+    // sbrk'd pages that were never touched have nothing to copy
+    if((pte = walkpgdir(pgdir, (void *) i, 0)) == 0 || *pte == 0)
+      continue;
+    if(is_zeropage(pte)){
+      if(mappages(d, (void*)i, PGSIZE, V2P(zeropage), PTE_FLAGS(*pte)) < 0)
+        goto bad;
+      continue;
+    }
     if(!(*pte & PTE_P) && !(*pte & PTE_PG))
       panic("copyuvm: page not present");
 
@@ -602,7 +725,13 @@ add_flag_to_pte(uint flag, void* va){
     struct proc *p = myproc();
     pde_t* pgdir = p->pgdir;
     pte_t * pte = walkpgdir(pgdir,va, 0);   
-    if(*pte & PTE_P || *pte & PTE_PG){ 
+    // flags only go on private frames, never on the shared zero page
+    if(is_zeropage(pte)){
+      if(lazy_page_fault(va, 1) < 0)
+        return -1;
+      pte = walkpgdir(pgdir, va, 0);
+    }
+    if(pte && (*pte & PTE_P || *pte & PTE_PG)){ 
       *pte = *pte | flag; 
       return 0;
     }
@@ -617,7 +746,7 @@ remove_flag_from_pte(uint flag, void* va){
     struct proc *p = myproc();
     pde_t* pgdir = p->pgdir;
     pte_t * pte = walkpgdir(pgdir,va, 0);
-    if(*pte & PTE_P || *pte & PTE_PG){ 
+    if(pte && (*pte & PTE_P || *pte & PTE_PG)){ 
       // check that the removed flag was on the flags before
       *pte = *pte & ~flag;
       return 0;
@@ -634,12 +763,12 @@ check_flag_on_pte(uint flag, void* va){
     pde_t* pgdir = p->pgdir;
     pte_t * pte = walkpgdir(pgdir,va, 0);  
 
-    if(*pte & PTE_P || *pte & PTE_PG){
+    if(pte && (*pte & PTE_P || *pte & PTE_PG)){
       if(*pte & flag){
         return 0;
       }
     }
-    else{
+    else if(pte){
       cprintf("in check_flag_on_pte pte not PTE_P or PTE_PG va: 0x%x, *pte:  0x%x, flag: %x\n", va, *pte, flag);
     }
   }
@@ -753,13 +882,35 @@ update_min_swapfile_offset(int unused_offset){
 }
 
 
+// Remember an evicted page so a fault on it soon after can be
+// counted as a refault, a miss of the replacement policy.
+void
+note_victim(struct proc* p, void* va)
+{
+  p->victims[p->next_victim] = (uint)va;
+  p->next_victim = (p->next_victim + 1) % MAX_PSYC_PAGES;
+}
+
+static int
+is_recent_victim(struct proc* p, uint va)
+{
+  int i;
+
+  for(i = 0; i < MAX_PSYC_PAGES; i++)
+    if(p->victims[i] == va)
+      return 1;
+  return 0;
+}
+
 void
 swap_page_OUT(pde_t* pgdir){
   // choose page to move to disk
   struct page_data* pd;
   struct proc* p = myproc();
+  unsigned long long start = rdtsc();
   p->paged_out_counter = p->paged_out_counter+1;
   void* va = choose_page_to_swap_out(pgdir);
+  note_victim(p, va);
   pte_t * pte = walkpgdir(pgdir,va, 0);
   int counter = 0;  
   // check if there's place on the pages_OUT
@@ -803,6 +954,7 @@ swap_page_OUT(pde_t* pgdir){
   }  
   if(pgdir == p->pgdir)
     lcr3(V2P(pgdir));
+  p->swapout_cycles += rdtsc() - start;
 }
 
 int
@@ -837,6 +989,7 @@ get_write_protected_pages_count(struct proc* p, struct page_data* pages_meta_dat
 void
 swap_page_IN(void* va, pde_t* pgdir){
   struct proc *p = myproc();
+  unsigned long long start = rdtsc();
   void* requested_page_start = (void*) PGROUNDDOWN((uint)va);   
  
   if(get_pages_count(p->pages_IN) == MAX_PSYC_PAGES)
@@ -893,4 +1046,126 @@ swap_page_IN(void* va, pde_t* pgdir){
   // print_upages(p->pages_IN, "in swap_page_IN IN end");
   if(pgdir == p->pgdir)
     lcr3(V2P(pgdir));
+  p->swapin_cycles += rdtsc() - start;
+}
+
+// Stride detector for swap faults: a fault on the page right after the
+// previous one doubles the fault-around window (up to FAULT_AROUND_WINDOW),
+// anything else resets it to a single page.
+static int
+next_fault_window(struct proc* p, uint page)
+{
+  if(p->last_fault_va != 0 && page == p->last_fault_va + PGSIZE){
+    if(p->fault_window < FAULT_AROUND_WINDOW)
+      p->fault_window *= 2;
+    if(p->fault_window > FAULT_AROUND_WINDOW)
+      p->fault_window = FAULT_AROUND_WINDOW;
+  }
+  else
+    p->fault_window = 1;
+  return p->fault_window;
+}
+
+// Handle a fault on a paged out page. On a sequential access pattern the
+// pages following va that sit in consecutive swap file slots are brought
+// in together with one swap file read.
+void
+swap_page_IN_around(void* va, pde_t* pgdir)
+{
+  struct proc *p = myproc();
+  char* start = (char*) PGROUNDDOWN((uint)va);
+  struct page_data* batch[FAULT_AROUND_WINDOW];
+  char* victim_buffer[FAULT_AROUND_WINDOW];
+  void* victim_va[FAULT_AROUND_WINDOW];
+  int writable[FAULT_AROUND_WINDOW];
+  struct page_data* pd;
+  pte_t* pte;
+  char* a;
+  char* ka;
+  int window, n, i, victims, first_offset;
+  long long time_counter;
+  unsigned long long start_cycles;
+
+  if(is_recent_victim(p, (uint)start))
+    p->refaults++;
+  window = next_fault_window(p, (uint)start);
+  batch[0] = get_page_data(p->pages_OUT, start);
+  if(window == 1 || batch[0] == 0 || batch[0]->fileOffset < 0 || p->temp_page.buffer != 0)
+    goto single;
+  first_offset = batch[0]->fileOffset;
+  for(n = 1; n < window; n++){
+    a = start + n*PGSIZE;
+    if((uint)a >= p->sz)
+      break;
+    pte = walkpgdir(pgdir, a, 0);
+    if(pte == 0 || (*pte & PTE_P) || !(*pte & PTE_PG))
+      break;
+    pd = get_page_data(p->pages_OUT, a);
+    if(pd == 0 || pd->fileOffset != first_offset + n)
+      break;
+    batch[n] = pd;
+  }
+  if(n == 1)
+    goto single;
+
+  start_cycles = rdtsc();
+  // make room in physical memory for the whole batch
+  victims = n - (MAX_PSYC_PAGES - get_pages_count(p->pages_IN));
+  if(victims < 0)
+    victims = 0;
+  for(i = 0; i < victims; i++){
+    victim_va[i] = choose_page_to_swap_out(pgdir);
+    note_victim(p, victim_va[i]);
+    if((victim_buffer[i] = kalloc()) == 0)
+      panic("swap_page_IN_around: kalloc");
+    memmove(victim_buffer[i], victim_va[i], PGSIZE);
+    pte = walkpgdir(pgdir, victim_va[i], 0);
+    kfree(P2V(PTE_ADDR(*pte)));
+    *pte &= ~PTE_P;
+    *pte |= PTE_PG;
+    p->paged_out_counter = p->paged_out_counter+1;
+  }
+  if(pgdir == p->pgdir)
+    lcr3(V2P(pgdir));
+
+  // map the batch writable and fill it with a single read
+  for(i = 0; i < n; i++){
+    a = start + i*PGSIZE;
+    if((ka = kalloc()) == 0)
+      panic("swap_page_IN_around: kalloc");
+    pte = walkpgdir(pgdir, a, 0);
+    writable[i] = *pte & PTE_W;
+    *pte = V2P(ka) | PTE_P | PTE_U | PTE_W | (*pte & PTE_PR);
+  }
+  readFromSwapFile(p, start, first_offset*PGSIZE, n*PGSIZE);
+
+  for(i = 0; i < n; i++){
+    a = start + i*PGSIZE;
+    pte = walkpgdir(pgdir, a, 0);
+    if(!writable[i])
+      *pte &= ~PTE_W;
+    if(i < victims){
+      // the victim takes over the swap slot the batch page just left
+      batch[i]->va = victim_va[i];
+      writeToSwapFile(p, victim_buffer[i], batch[i]->fileOffset*PGSIZE, PGSIZE);
+      kfree(victim_buffer[i]);
+    }
+    else{
+      update_min_swapfile_offset(batch[i]->fileOffset);
+      update_upages(p->pages_OUT, a);
+    }
+    time_counter = add_to_upages(p->pages_IN, a, p->time_load_counter);
+    if(time_counter < 0)
+      panic("swap_page_IN_around: add_to_upages failed");
+    p->time_load_counter = time_counter;
+  }
+  p->last_fault_va = (uint)start + (n-1)*PGSIZE;
+  if(pgdir == p->pgdir)
+    lcr3(V2P(pgdir));
+  p->swapin_cycles += rdtsc() - start_cycles;
+  return;
+
+single:
+  p->last_fault_va = (uint)start;
+  swap_page_IN(va, pgdir);
 }
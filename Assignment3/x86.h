@@ -130,6 +130,15 @@ xchg(volatile uint *addr, uint newval)
   return result;
 }
 
+static inline unsigned long long
+rdtsc(void)
+{
+  unsigned long long val;
+
+  asm volatile("rdtsc" : "=A" (val));
+  return val;
+}
+
 static inline uint
 rcr2(void)
 {
@@ -0,0 +1,16 @@
+// Compressed swap cache statistics, filled in by zswap_stat().
+struct zswapstat {
+  uint stored;        // swap pages currently held in the pool
+  uint same_filled;   // of those, pages of one repeated word (no pool space)
+  uint pool_bytes;    // pool space in use
+  uint pool_size;     // total pool space
+  uint stores;        // pages accepted into the pool
+  uint rejects;       // pages sent to the swap area instead
+  uint writebacks;    // pool pages moved to the swap area to make room
+  uint loads;         // swap-in page reads
+  uint hits;          // swap-in page reads served from the pool
+  uint orig_bytes;    // uncompressed size of the pages accepted
+  uint comp_bytes;    // compressed size of the pages accepted
+  uint page_faults;   // page_faults_counter of the calling process
+  uint paged_out;     // paged_out_counter of the calling process
+};
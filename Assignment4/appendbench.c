@@ -0,0 +1,55 @@
+// Append benchmark: writes NREC records of RECLEN bytes to the
+// end of a file, one write each, the way a program keeps a log,
+// then fsync()s it. Reports the ticks the appends and the fsync
+// take and how many log commits each caused (Commits in
+// /proc/loginfo).
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+
+#define NREC 4000
+#define RECLEN 64
+
+char rec[RECLEN];
+
+int
+main(int argc, char *argv[])
+{
+  int fd, i, start, commits, wticks, wcommits, sticks, scommits;
+
+  if((fd = open("appendbench.log", O_CREATE | O_RDWR)) < 0){
+    printf(1, "appendbench: cannot create appendbench.log\n");
+    exit();
+  }
+  memset(rec, 'r', sizeof(rec));
+  rec[RECLEN-1] = '\n';
+
+  commits = procinfo("/proc/loginfo", "Commits: ");
+  start = uptime();
+  for(i = 0; i < NREC; i++){
+    if(write(fd, rec, sizeof(rec)) != sizeof(rec)){
+      printf(1, "appendbench: write failed\n");
+      exit();
+    }
+  }
+  wticks = uptime() - start;
+  wcommits = procinfo("/proc/loginfo", "Commits: ") - commits;
+
+  commits = procinfo("/proc/loginfo", "Commits: ");
+  start = uptime();
+  if(fsync(fd) < 0){
+    printf(1, "appendbench: fsync failed\n");
+    exit();
+  }
+  sticks = uptime() - start;
+  scommits = procinfo("/proc/loginfo", "Commits: ") - commits;
+  close(fd);
+  unlink("appendbench.log");
+
+  printf(1, "appendbench: %d appends of %d bytes in %d ticks, %d commits\n",
+         NREC, RECLEN, wticks, wcommits);
+  printf(1, "appendbench: fsync in %d ticks, %d commits\n", sticks, scommits);
+  exit();
+}
@@ -1,6 +1,6 @@
 // Buffer cache.
 //
-// The buffer cache is a linked list of buf structures holding
+// The buffer cache is a hash table of buf structures holding
 // cached copies of disk block contents.  Caching disk blocks
 // in memory reduces the number of disk reads and also provides
 // a synchronization point for disk blocks used by multiple processes.
@@ -17,42 +17,185 @@
 // * B_VALID: the buffer data has been read from the disk.
 // * B_DIRTY: the buffer data has been modified
 //     and needs to be written to disk.
+//
+// The log keeps blocks it has not yet installed in the cache
+// with bpin(), which holds an extra reference.
+//
+// breadahead() starts a read and releases the buffer at once;
+// B_READAHEAD marks it until the disk is done, so that it is
+// not recycled meanwhile and bread() waits instead of reading
+// it again.
+//
+// Buffers are hashed on (dev, blockno) into NBUCKET buckets.
+// Each bucket has its own spin-lock and its own LRU list, so
+// lookups of different blocks rarely contend. bcache.lock is
+// only taken on a miss, to serialize recycling of buffers
+// between buckets.  Lock order: bcache.lock, then the bucket
+// the block hashes to, then at most one other bucket.
+//
+// The buffers themselves are allocated by binit() from the
+// free page pool, so the size of the cache follows the amount
+// of physical memory.
 
 #include "types.h"
 #include "defs.h"
 #include "param.h"
+#include "mmu.h"
 #include "spinlock.h"
 #include "sleeplock.h"
 #include "fs.h"
 #include "buf.h"
 
-struct {
+#define BHASH(dev, blockno) (((dev)*31 + (blockno)) % NBUCKET)
+
+struct bucket {
   struct spinlock lock;
-  struct buf buf[NBUF];
+  struct buf *head;  // most recently used; head->prev is least
+  uint lookups;
+  uint hits;
+  uint scanned;      // buffers compared during lookups
+};
 
-  // Linked list of all buffers, through prev/next.
-  // head.next is most recently used.
-  struct buf head;
+struct {
+  struct spinlock lock;
+  struct buf *free;  // never used buffers, through next
+  int nbuf;
+  int steal;         // next bucket to take a buffer from
+  uint evictions;
+  struct bucket bucket[NBUCKET];
 } bcache;
 
+// Remove b from the LRU list of bk.
+static void
+bunlink(struct bucket *bk, struct buf *b)
+{
+  if(b->next == b){
+    bk->head = 0;
+    return;
+  }
+  b->next->prev = b->prev;
+  b->prev->next = b->next;
+  if(bk->head == b)
+    bk->head = b->next;
+}
+
+// Make b the most recently used buffer of bk.
+static void
+bpush(struct bucket *bk, struct buf *b)
+{
+  if(bk->head == 0){
+    b->next = b;
+    b->prev = b;
+  } else {
+    b->next = bk->head;
+    b->prev = bk->head->prev;
+    bk->head->prev->next = b;
+    bk->head->prev = b;
+  }
+  bk->head = b;
+}
+
+// Must be called after kinit2(), since the buffers
+// come from the page allocator.
 void
 binit(void)
 {
   struct buf *b;
+  char *page;
+  int i, n, perpage;
 
   initlock(&bcache.lock, "bcache");
+  for(i = 0; i < NBUCKET; i++)
+    initlock(&bcache.bucket[i].lock, "bcache.bucket");
 
 //PAGEBREAK!
-  // Create linked list of buffers
-  bcache.head.prev = &bcache.head;
-  bcache.head.next = &bcache.head;
-  for(b = bcache.buf; b < bcache.buf+NBUF; b++){
-    b->next = bcache.head.next;
-    b->prev = &bcache.head;
-    initsleeplock(&b->lock, "buffer");
-    bcache.head.next->prev = b;
-    bcache.head.next = b;
+  perpage = PGSIZE / sizeof(struct buf);
+  n = kfreecount() / BCACHEFRAC * perpage;
+  if(n > NBUFMAX)
+    n = NBUFMAX;
+  if(n < NBUF)
+    n = NBUF;
+
+  // Carve the buffers out of whole pages and put them
+  // on the free list.
+  for(bcache.nbuf = 0; bcache.nbuf < n; bcache.nbuf += perpage){
+    if((page = kalloc()) == 0)
+      panic("binit");
+    for(b = (struct buf*)page; b < (struct buf*)page + perpage; b++){
+      memset(b, 0, sizeof(*b));
+      initsleeplock(&b->lock, "buffer");
+      b->next = bcache.free;
+      bcache.free = b;
+    }
   }
+  cprintf("bcache: %d buffers, %d buckets\n", bcache.nbuf, NBUCKET);
+}
+
+// Look for the block in bk. Caller holds bk->lock.
+static struct buf*
+bfind(struct bucket *bk, uint dev, uint blockno)
+{
+  struct buf *b;
+
+  if((b = bk->head) == 0)
+    return 0;
+  do {
+    bk->scanned++;
+    if(b->dev == dev && b->blockno == blockno)
+      return b;
+    b = b->next;
+  } while(b != bk->head);
+  return 0;
+}
+
+// Take the least recently used idle buffer of bk off its list.
+// Caller holds bk->lock.
+static struct buf*
+btake(struct bucket *bk)
+{
+  struct buf *b;
+
+  if(bk->head == 0)
+    return 0;
+  b = bk->head->prev;
+  do {
+    if(b->refcnt == 0 && (b->flags & B_READAHEAD) == 0){
+      bunlink(bk, b);
+      return b;
+    }
+    b = b->prev;
+  } while(b != bk->head->prev);
+  return 0;
+}
+
+// Find a buffer to recycle for a block that hashes to bk.
+// Caller holds bcache.lock and bk->lock.
+static struct buf*
+bevict(struct bucket *bk)
+{
+  struct bucket *other;
+  struct buf *b;
+  int i;
+
+  if((b = bcache.free) != 0){
+    bcache.free = b->next;
+    return b;
+  }
+  bcache.evictions++;
+  if((b = btake(bk)) != 0)
+    return b;
+  for(i = 0; i < NBUCKET; i++){
+    other = &bcache.bucket[bcache.steal];
+    bcache.steal = (bcache.steal + 1) % NBUCKET;
+    if(other == bk)
+      continue;
+    acquire(&other->lock);
+    b = btake(other);
+    release(&other->lock);
+    if(b)
+      return b;
+  }
+  return 0;
 }
 
 // Look through buffer cache for block on device dev.
@@ -61,35 +204,58 @@ binit(void)
 static struct buf*
 bget(uint dev, uint blockno)
 {
+  struct bucket *bk;
   struct buf *b;
 
-  acquire(&bcache.lock);
+  bk = &bcache.bucket[BHASH(dev, blockno)];
+  acquire(&bk->lock);
+  bk->lookups++;
 
   // Is the block already cached?
-  for(b = bcache.head.next; b != &bcache.head; b = b->next){
-    if(b->dev == dev && b->blockno == blockno){
-      b->refcnt++;
-      release(&bcache.lock);
-      acquiresleep(&b->lock);
-      return b;
-    }
+  if((b = bfind(bk, dev, blockno)) != 0){
+    bk->hits++;
+    b->refcnt++;
+    release(&bk->lock);
+    acquiresleep(&b->lock);
+    return b;
   }
+  release(&bk->lock);
 
-  // Not cached; recycle an unused buffer.
-  // Even if refcnt==0, B_DIRTY indicates a buffer is in use
-  // because log.c has modified it but not yet committed it.
-  for(b = bcache.head.prev; b != &bcache.head; b = b->prev){
-    if(b->refcnt == 0 && (b->flags & B_DIRTY) == 0) {
-      b->dev = dev;
-      b->blockno = blockno;
-      b->flags = 0;
-      b->refcnt = 1;
-      release(&bcache.lock);
-      acquiresleep(&b->lock);
-      return b;
-    }
+  // Not cached; recycle an unused buffer. Look again once
+  // the bucket is locked for recycling, since another process
+  // may have read the block in the meantime.
+  acquire(&bcache.lock);
+  acquire(&bk->lock);
+  if((b = bfind(bk, dev, blockno)) != 0){
+    bk->hits++;
+    b->refcnt++;
+  } else {
+    if((b = bevict(bk)) == 0)
+      panic("bget: no buffers");
+    b->dev = dev;
+    b->blockno = blockno;
+    b->flags = 0;
+    b->refcnt = 1;
+    bpush(bk, b);
   }
-  panic("bget: no buffers");
+  release(&bk->lock);
+  release(&bcache.lock);
+  acquiresleep(&b->lock);
+  return b;
+}
+
+// Start reading locked buffer b unless its data is valid or a
+// read of it is on its way already. The interrupt sets B_VALID
+// before it clears B_READAHEAD, so one look at the flags says
+// which.
+static void
+bstart(struct buf *b)
+{
+  int flags;
+
+  flags = b->flags;
+  if((flags & (B_VALID|B_READAHEAD)) == 0)
+    iderw_start(b);
 }
 
 // Return a locked buf with the contents of the indicated block.
@@ -99,12 +265,49 @@ bread(uint dev, uint blockno)
   struct buf *b;
 
   b = bget(dev, blockno);
-  if((b->flags & B_VALID) == 0) {
-    iderw(b);
-  }
+  bstart(b);
+  bread_wait(b);
   return b;
 }
 
+// Like bread, but only start reading the block, so that reads
+// of many blocks can be queued at once and merged by the disk.
+// The caller must bread_wait(b) before using the data.
+struct buf*
+bread_async(uint dev, uint blockno)
+{
+  struct buf *b;
+
+  b = bget(dev, blockno);
+  bstart(b);
+  return b;
+}
+
+// Wait for a read started by bread_async().
+void
+bread_wait(struct buf *b)
+{
+  if(!holdingsleep(&b->lock))
+    panic("bread_wait");
+  if((b->flags & B_VALID) == 0)
+    iderw_wait(b);
+}
+
+// Start reading the block into the cache for someone who will
+// want it soon, and return without waiting or keeping it.
+void
+breadahead(uint dev, uint blockno)
+{
+  struct buf *b;
+
+  b = bget(dev, blockno);
+  if((b->flags & (B_VALID|B_READAHEAD)) == 0){
+    b->flags |= B_READAHEAD;
+    iderw_start(b);
+  }
+  brelse(b);
+}
+
 // Write b's contents to disk.  Must be locked.
 void
 bwrite(struct buf *b)
@@ -115,30 +318,112 @@ bwrite(struct buf *b)
   iderw(b);
 }
 
+// Start writing b's contents to disk and return at once, so that
+// the disk can merge it with other writes.  b must stay locked
+// until bwait(b) returns.
+void
+bwrite_async(struct buf *b)
+{
+  if(!holdingsleep(&b->lock))
+    panic("bwrite_async");
+  b->flags |= B_DIRTY;
+  iderw_start(b);
+}
+
+// Wait for a write started by bwrite_async().
+void
+bwait(struct buf *b)
+{
+  if(!holdingsleep(&b->lock))
+    panic("bwait");
+  iderw_wait(b);
+}
+
 // Release a locked buffer.
-// Move to the head of the MRU list.
+// Move to the head of its bucket's MRU list.
 void
 brelse(struct buf *b)
 {
+  struct bucket *bk;
+
   if(!holdingsleep(&b->lock))
     panic("brelse");
 
   releasesleep(&b->lock);
 
-  acquire(&bcache.lock);
+  bk = &bcache.bucket[BHASH(b->dev, b->blockno)];
+  acquire(&bk->lock);
   b->refcnt--;
   if (b->refcnt == 0) {
     // no one is waiting for it.
-    b->next->prev = b->prev;
-    b->prev->next = b->next;
-    b->next = bcache.head.next;
-    b->prev = &bcache.head;
-    bcache.head.next->prev = b;
-    bcache.head.next = b;
+    bunlink(bk, b);
+    bpush(bk, b);
   }
-  
-  release(&bcache.lock);
+  release(&bk->lock);
 }
-//PAGEBREAK!
-// Blank page.
 
+// Keep b in the cache until bunpin(b), without locking it.
+void
+bpin(struct buf *b)
+{
+  struct bucket *bk = &bcache.bucket[BHASH(b->dev, b->blockno)];
+
+  acquire(&bk->lock);
+  b->refcnt++;
+  release(&bk->lock);
+}
+
+void
+bunpin(struct buf *b)
+{
+  struct bucket *bk = &bcache.bucket[BHASH(b->dev, b->blockno)];
+
+  acquire(&bk->lock);
+  b->refcnt--;
+  release(&bk->lock);
+}
+
+// Number of buffers, for bounding how many reads may be in
+// flight at once.
+int
+bcachesize(void)
+{
+  return bcache.nbuf;
+}
+
+int
+get_bcacheinfo_file_string(char* dst)
+{
+  struct bucket *bk;
+  uint lookups = 0, hits = 0, scanned = 0;
+  int off = 0;
+  int used = 0;
+
+  for(bk = bcache.bucket; bk < &bcache.bucket[NBUCKET]; bk++){
+    acquire(&bk->lock);
+    lookups += bk->lookups;
+    hits += bk->hits;
+    scanned += bk->scanned;
+    if(bk->head)
+      used++;
+    release(&bk->lock);
+  }
+
+  char buffers_str[] = "Buffers: ";
+  off+=add_string_number(dst,off,buffers_str,bcache.nbuf,add_space);
+  char buckets_str[] = "Buckets in use: ";
+  off+=add_string_number(dst,off,buckets_str,used,add_space);
+  char lookups_str[] = "Lookups: ";
+  off+=add_string_number(dst,off,lookups_str,lookups,add_space);
+  char hits_str[] = "Hits: ";
+  off+=add_string_number(dst,off,hits_str,hits,add_space);
+  char misses_str[] = "Misses: ";
+  off+=add_string_number(dst,off,misses_str,lookups-hits,add_space);
+  char evictions_str[] = "Evictions: ";
+  off+=add_string_number(dst,off,evictions_str,bcache.evictions,add_space);
+  char hit_rate_str[] = "Hit rate (%): ";
+  off+=add_string_number(dst,off,hit_rate_str,lookups ? hits*100/lookups : 0,add_space);
+  char scan_str[] = "Compares per lookup (x100): ";
+  off+=add_string_number(dst,off,scan_str,lookups ? scanned*100/lookups : 0,add_space);
+  return off;
+}
@@ -7,8 +7,11 @@ struct buf {
   struct buf *prev; // LRU cache list
   struct buf *next;
   struct buf *qnext; // disk queue
+  uint qticks;       // when queued, for the disk deadline
+  uint qcycles;      // when queued, for disk service time
   uchar data[BSIZE];
 };
 #define B_VALID 0x2  // buffer has been read from disk
 #define B_DIRTY 0x4  // buffer needs to be written to disk
+#define B_READAHEAD 0x8  // being read by breadahead(), unlocked
 
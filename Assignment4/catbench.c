@@ -0,0 +1,67 @@
+// Cold-cache sequential read benchmark. The first run writes
+// FILEBLOCKS blocks to catbench.dat (or uses the file named on
+// the command line) and asks for a reboot; run it again right
+// after booting, when none of the file is cached, and it reads
+// the file the way cat does, 512 bytes at a time, then once
+// more from the caches. Reports the ticks each read takes.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fs.h"
+#include "fcntl.h"
+
+#define FILEBLOCKS 8192   // 4MB
+
+char data[BSIZE];
+
+// Read all of path as cat would, and return the ticks taken.
+int
+readall(char *path, int *bytes)
+{
+  int fd, n, start;
+
+  if((fd = open(path, O_RDONLY)) < 0){
+    printf(1, "catbench: cannot open %s\n", path);
+    exit();
+  }
+  *bytes = 0;
+  start = uptime();
+  while((n = read(fd, data, sizeof(data))) > 0)
+    *bytes += n;
+  close(fd);
+  return uptime() - start;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int fd, i, cold, warm, bytes;
+  char *path;
+
+  path = argc > 1 ? argv[1] : "catbench.dat";
+  if((fd = open(path, O_RDONLY)) < 0){
+    if((fd = open(path, O_CREATE | O_RDWR)) < 0){
+      printf(1, "catbench: cannot create %s\n", path);
+      exit();
+    }
+    memset(data, 'c', sizeof(data));
+    for(i = 0; i < FILEBLOCKS; i++){
+      if(write(fd, data, sizeof(data)) != sizeof(data)){
+        printf(1, "catbench: write failed\n");
+        exit();
+      }
+    }
+    fsync(fd);
+    close(fd);
+    printf(1, "catbench: wrote %s; reboot and run catbench again\n", path);
+    exit();
+  }
+  close(fd);
+
+  cold = readall(path, &bytes);
+  warm = readall(path, &bytes);
+  printf(1, "catbench: %d KB: cold %d ticks, cached %d ticks\n",
+         bytes / 1024, cold, warm);
+  exit();
+}
@@ -0,0 +1,256 @@
+// Clock and timers.
+//
+// At boot the TSC is timed against channel 2 of the PIT, and
+// lapicinit() then times the local APIC timer against the TSC,
+// so that it interrupts every CPU WHEELHZ times a second. Each
+// CPU counts its own interrupts (cpu->jiffies) and every
+// TICKDIV-th is a clock tick, at which it yields the CPU. CPU 0
+// also calls clockintr() on each of them, which advances the
+// time in the vdso page (see clock.h), fires the timers due,
+// and bumps ticks at each tick.
+//
+// Timers live on a hashed timing wheel: a timer due at jiffy
+// j is on the list of slot j % NWHEEL, so each interrupt only
+// looks at one short list, however many timers are pending.
+// Timers more than NWHEEL jiffies away stay on their list for
+// more turns of the wheel.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "x86.h"
+#include "proc.h"
+#include "spinlock.h"
+#include "clock.h"
+
+#define PITHZ     1193182   // PIT input clock
+#define PITCH2    0x42      // PIT channel 2 count
+#define PITMODE   0x43      // PIT mode register
+#define PITGATE   0x61      // channel 2 gate (bit 0) and output (bit 5)
+#define JIFFYNS   (NSEC / WHEELHZ)
+
+struct timer {
+  uint when;              // jiffy at which it fires
+  int fired;
+  struct timer *next;
+};
+
+struct {
+  struct spinlock lock;
+  uint now;               // jiffies since boot
+  struct timer *slot[NWHEEL];
+} wheel;
+
+static struct vdso *vdso;
+static uint tscmhz;       // TSC cycles per microsecond, or 0
+
+// (n>>32):n / d, whose quotient must fit in 32 bits, without
+// the 64-bit division the kernel has no library routine for.
+static uint
+div64(unsigned long long n, uint d)
+{
+  uint q, r;
+
+  asm("divl %4" : "=a" (q), "=d" (r) : "a" ((uint)n), "d" ((uint)(n >> 32)), "rm" (d));
+  return q;
+}
+
+// Count the TSC cycles in 10ms, timed by PIT channel 2 counting
+// down once, or return 0 if the PIT does not seem to count.
+static uint
+tsccalibrate(void)
+{
+  unsigned long long t0, t1;
+  uint latch, i;
+
+  latch = PITHZ / 100;
+  outb(PITGATE, (inb(PITGATE) & ~0x02) | 0x01);  // gate on, speaker off
+  outb(PITMODE, 0xB0);  // channel 2, low then high byte, count down once
+  outb(PITCH2, latch & 0xFF);
+  outb(PITCH2, latch >> 8);
+  t0 = rdtsc();
+  for(i = 0; (inb(PITGATE) & 0x20) == 0; i++)
+    if(i > 100000000)
+      return 0;
+  t1 = rdtsc();
+  return t1 - t0;
+}
+
+// Must be called after kinit1() and before lapicinit().
+void
+clockinit(void)
+{
+  uint cycles;
+
+  initlock(&wheel.lock, "wheel");
+  if((vdso = (struct vdso*)kalloc()) == 0)
+    panic("clockinit");
+  memset(vdso, 0, PGSIZE);
+
+  cycles = tsccalibrate();
+  if(cycles <= (unsigned long long)(NSEC/100) << CLOCKSHIFT >> 32){
+    cprintf("clock: no PIT, clock counts in jiffies\n");
+    return;
+  }
+  tscmhz = cycles / 10000;
+  vdso->mult = div64((unsigned long long)(NSEC/100) << CLOCKSHIFT, cycles);
+  vdso->tsc = rdtsc();
+  cprintf("clock: TSC %d MHz\n", tscmhz);
+}
+
+// Spin for us microseconds. Returns -1 at once if the TSC has
+// not been timed.
+int
+tscdelay(uint us)
+{
+  unsigned long long t0;
+
+  if(tscmhz == 0)
+    return -1;
+  t0 = rdtsc();
+  while(rdtsc() - t0 < (unsigned long long)us * tscmhz)
+    ;
+  return 0;
+}
+
+// Map the vdso page read-only at VDSO in pgdir.
+int
+vdsomap(pde_t *pgdir)
+{
+  if(vdso == 0)
+    return 0;
+  return mappages(pgdir, (char*)VDSO, PGSIZE, V2P(vdso), PTE_U);
+}
+
+// Read the clock, as clock_gettime() in ulib.c does.
+void
+clockread(struct timespec *ts)
+{
+  unsigned long long tsc;
+  uint seq, sec, nsec, mult;
+
+  do {
+    while((seq = vdso->seq) & 1)
+      ;
+    __sync_synchronize();
+    tsc = vdso->tsc;
+    sec = vdso->sec;
+    nsec = vdso->nsec;
+    mult = vdso->mult;
+    __sync_synchronize();
+  } while(vdso->seq != seq);
+
+  if(mult)
+    nsec += (rdtsc() - tsc) * mult >> CLOCKSHIFT;
+  while(nsec >= NSEC){
+    nsec -= NSEC;
+    sec++;
+  }
+  ts->tv_sec = sec;
+  ts->tv_nsec = nsec;
+}
+
+// Called by CPU 0 on every timer interrupt; tick is set when
+// the interrupt is also a clock tick.
+void
+clockintr(int tick)
+{
+  unsigned long long tsc;
+  struct timer **pp, *t;
+
+  tsc = rdtsc();
+  vdso->seq++;
+  __sync_synchronize();
+  if(vdso->mult)
+    vdso->nsec += (tsc - vdso->tsc) * vdso->mult >> CLOCKSHIFT;
+  else
+    vdso->nsec += JIFFYNS;
+  while(vdso->nsec >= NSEC){
+    vdso->nsec -= NSEC;
+    vdso->sec++;
+  }
+  vdso->tsc = tsc;
+  __sync_synchronize();
+  vdso->seq++;
+
+  acquire(&wheel.lock);
+  wheel.now++;
+  for(pp = &wheel.slot[wheel.now % NWHEEL]; (t = *pp) != 0; ){
+    if(t->when == wheel.now){
+      *pp = t->next;
+      t->fired = 1;
+      wakeup(t);
+    } else
+      pp = &t->next;
+  }
+  release(&wheel.lock);
+
+  if(tick){
+    acquire(&tickslock);
+    ticks++;
+    wakeup(&ticks);
+    release(&tickslock);
+  }
+}
+
+// Sleep for n jiffies, or until killed (then return -1).
+// The current jiffy counts as the first.
+int
+jsleep(uint n)
+{
+  struct timer t, **pp;
+
+  if(n == 0)
+    return 0;
+  acquire(&wheel.lock);
+  t.when = wheel.now + n;
+  t.fired = 0;
+  pp = &wheel.slot[t.when % NWHEEL];
+  t.next = *pp;
+  *pp = &t;
+  while(!t.fired){
+    if(myproc()->killed){
+      for(pp = &wheel.slot[t.when % NWHEEL]; *pp != &t; pp = &(*pp)->next)
+        ;
+      *pp = t.next;
+      release(&wheel.lock);
+      return -1;
+    }
+    sleep(&t, &wheel.lock);
+  }
+  release(&wheel.lock);
+  return 0;
+}
+
+// Sleep for at least the time in ts, or until killed.
+int
+nsleep(struct timespec *ts)
+{
+  struct timespec now, end;
+  uint n, sec;
+
+  if(ts->tv_nsec >= NSEC)
+    return -1;
+  sec = ts->tv_sec < 1000000 ? ts->tv_sec : 1000000;
+  clockread(&end);
+  end.tv_sec += sec;
+  if((end.tv_nsec += ts->tv_nsec) >= NSEC){
+    end.tv_nsec -= NSEC;
+    end.tv_sec++;
+  }
+
+  // Sleep through the whole jiffies first, then a jiffy at a
+  // time until the clock passes end.
+  n = sec * WHEELHZ + ts->tv_nsec / JIFFYNS;
+  for(;;){
+    if(jsleep(n) < 0)
+      return -1;
+    clockread(&now);
+    if(now.tv_sec > end.tv_sec ||
+       (now.tv_sec == end.tv_sec && now.tv_nsec >= end.tv_nsec))
+      return 0;
+    n = 1;
+  }
+}
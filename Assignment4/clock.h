@@ -0,0 +1,23 @@
+// The monotonic clock. The kernel keeps the time in a page
+// (struct vdso) that every process has mapped read-only at
+// VDSO, so clock_gettime() in ulib.c reads it without a system
+// call: the time at the last timer interrupt, plus the TSC
+// cycles since then converted to nanoseconds.
+
+#define CLOCK_MONOTONIC 1
+#define NSEC       1000000000  // nanoseconds per second
+#define CLOCKSHIFT 22          // ns = cycles * vdso.mult >> CLOCKSHIFT
+#define VDSO       0x7FFFF000  // user address of the vdso page, just below KERNBASE
+
+struct timespec {
+  uint tv_sec;
+  uint tv_nsec;
+};
+
+struct vdso {
+  volatile uint seq;        // odd while the kernel updates the rest
+  unsigned long long tsc;   // TSC when the time below was taken
+  uint sec;                 // time since boot at tsc
+  uint nsec;
+  uint mult;                // cycles to ns, or 0 if the TSC is not used
+};
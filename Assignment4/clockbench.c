@@ -0,0 +1,71 @@
+// Clock benchmark: reads the monotonic clock NREAD times from
+// the vdso page and NREAD times through the system call, and
+// reports the nanoseconds per read; then sleeps NSLEEP times for
+// each of a few sub-tick times and reports how long the sleeps
+// really took, and how long a one-tick sleep() takes.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "clock.h"
+
+#define NREAD  100000
+#define NSLEEP 20
+
+// Nanoseconds from a to b, which must be less than four
+// seconds after it.
+uint
+nsbetween(struct timespec *a, struct timespec *b)
+{
+  return (b->tv_sec - a->tv_sec)*NSEC + b->tv_nsec - a->tv_nsec;
+}
+
+// Return the average ns one call of the n sleeps takes, asking
+// for ns each time, or for a tick if ns is 0.
+uint
+sleeps(uint ns, int n)
+{
+  struct timespec a, b, d;
+  int i;
+
+  d.tv_sec = 0;
+  d.tv_nsec = ns;
+  clock_gettime(CLOCK_MONOTONIC, &a);
+  for(i = 0; i < n; i++){
+    if(ns)
+      nanosleep(&d);
+    else
+      sleep(1);
+  }
+  clock_gettime(CLOCK_MONOTONIC, &b);
+  return nsbetween(&a, &b) / n;
+}
+
+int
+main(int argc, char *argv[])
+{
+  static uint asked[] = { 100000, 1000000, 2500000 };
+  struct timespec a, b, t;
+  uint vdso, sys;
+  int i;
+
+  clock_gettime(CLOCK_MONOTONIC, &a);
+  for(i = 0; i < NREAD; i++)
+    clock_gettime(CLOCK_MONOTONIC, &t);
+  clock_gettime(CLOCK_MONOTONIC, &b);
+  vdso = nsbetween(&a, &b) / (NREAD / 1000);
+
+  clock_gettime(CLOCK_MONOTONIC, &a);
+  for(i = 0; i < NREAD; i++)
+    clocktime(CLOCK_MONOTONIC, &t);
+  clock_gettime(CLOCK_MONOTONIC, &b);
+  sys = nsbetween(&a, &b) / (NREAD / 1000);
+
+  printf(1, "clockbench: %d reads: vdso %d ns, system call %d ns per 1000 reads\n",
+         NREAD, vdso, sys);
+  for(i = 0; i < sizeof(asked)/sizeof(asked[0]); i++)
+    printf(1, "clockbench: nanosleep(%d ns) took %d ns\n",
+           asked[i], sleeps(asked[i], NSLEEP));
+  printf(1, "clockbench: sleep(1) took %d ns\n", sleeps(0, NSLEEP));
+  exit();
+}
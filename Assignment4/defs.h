@@ -1,20 +1,41 @@
 struct buf;
+struct timespec;
 struct context;
 struct file;
 struct inode;
+struct kmem_cache;
 struct pipe;
 struct proc;
 struct rtcdate;
 struct spinlock;
 struct sleeplock;
 struct stat;
+struct iovec;
 struct superblock;
 
 // bio.c
 void            binit(void);
 struct buf*     bread(uint, uint);
+struct buf*     bread_async(uint, uint);
+void            bread_wait(struct buf*);
+void            breadahead(uint, uint);
+int             bcachesize(void);
 void            brelse(struct buf*);
 void            bwrite(struct buf*);
+void            bwrite_async(struct buf*);
+void            bwait(struct buf*);
+void            bpin(struct buf*);
+void            bunpin(struct buf*);
+int             get_bcacheinfo_file_string(char*);
+
+// clock.c
+void            clockinit(void);
+void            clockintr(int);
+void            clockread(struct timespec*);
+int             jsleep(uint);
+int             nsleep(struct timespec*);
+int             tscdelay(uint);
+int             vdsomap(pde_t*);
 
 // console.c
 void            consoleinit(void);
@@ -32,14 +53,18 @@ struct file*    filedup(struct file*);
 void            fileinit(void);
 int             fileread(struct file*, char*, int n);
 int             filestat(struct file*, struct stat*);
+int             filesync(struct file*);
 int             filewrite(struct file*, char*, int n);
+int             filereadv(struct file*, struct iovec*, int, int);
+int             filewritev(struct file*, struct iovec*, int, int);
 int             get_filestat_file_string(char* dst);
 
 // fs.c
 void            readsb(int dev, struct superblock *sb);
 int             dirlink(struct inode*, char*, uint);
+void            dirunlink(struct inode*, char*, uint);
 struct inode*   dirlookup(struct inode*, char*, uint*);
-struct inode*   ialloc(uint, short);
+struct inode*   ialloc(uint, short, uint);
 struct inode*   idup(struct inode*);
 void            iinit(int dev);
 void            ilock(struct inode*);
@@ -51,14 +76,24 @@ int             namecmp(const char*, const char*);
 struct inode*   namei(char*);
 struct inode*   nameiparent(char*, char*);
 int             readi(struct inode*, char*, uint, uint);
+void            ireadpages(struct inode*, uint, int, char**);
+void            ireadahead(struct inode*, uint, uint);
+void            iflush(struct inode*);
+int             ureadi(struct inode*, char*, uint, uint);
 void            stati(struct inode*, struct stat*);
 int             writei(struct inode*, char*, uint, uint);
+int             uwritei(struct inode*, char*, uint, uint);
 struct inode*   get_ip_from_icache_index(int, int);
+int             get_fsinfo_file_string(char*);
+int             get_dcacheinfo_file_string(char*);
+int             get_icacheinfo_file_string(char*);
 
 // ide.c
 void            ideinit(void);
 void            ideintr(void);
 void            iderw(struct buf*);
+void            iderw_start(struct buf*);
+void            iderw_wait(struct buf*);
 int             get_ideinfo_file_string(char*);
 
 // ioapic.c
@@ -71,6 +106,10 @@ char*           kalloc(void);
 void            kfree(char*);
 void            kinit1(void*, void*);
 void            kinit2(void*, void*);
+int             kfreecount(void);
+char*           kallocn(int);
+void            kfreen(char*, int);
+int             get_meminfo_file_string(char*);
 
 // kbd.c
 void            kbdintr(void);
@@ -87,22 +126,48 @@ void            microdelay(int);
 // log.c
 void            initlog(int dev);
 void            log_write(struct buf*);
+int             get_loginfo_file_string(char*);
 void            begin_op();
 void            end_op();
+void            log_sync(void);
+
+// mmap.c
+int             mmap(struct file*, uint, int, int, uint);
+int             munmap(uint, uint);
+int             vmafault(uint);
+int             vmaprefault(uint, uint);
+int             vmarange(uint, uint);
+void            vmafree(struct proc*);
+int             vmafork(struct proc*);
+
+// main.c
+int             bootopt(char*);
 
 // mp.c
 extern int      ismp;
 void            mpinit(void);
 
+// pcache.c
+void            pcinit(void);
+char*           pget(struct inode*, uint);
+void            pput(struct inode*, uint);
+int             pcached(struct inode*, uint);
+void            pdirty(struct inode*, uint);
+char*           pclean(struct inode*, uint);
+int             pdirtyfull(void);
+void            pinval(struct inode*);
+int             get_pcacheinfo_file_string(char*);
+
 // picirq.c
 void            picenable(int);
 void            picinit(void);
 
 // pipe.c
+void            pipeinit(void);
 int             pipealloc(struct file**, struct file**);
 void            pipeclose(struct pipe*, int);
-int             piperead(struct pipe*, char*, int);
-int             pipewrite(struct pipe*, char*, int);
+int             piperead(struct pipe*, char*, int, int);
+int             pipewrite(struct pipe*, char*, int, int);
 
 //PAGEBREAK: 16
 // proc.c
@@ -111,6 +176,7 @@ void            exit(void);
 int             fork(void);
 int             growproc(int);
 int             kill(int);
+void            kproc(char*, void (*)(void));
 struct cpu*     mycpu(void);
 struct proc*    myproc();
 void            pinit(void);
@@ -132,6 +198,14 @@ int            add_string_number(char *, int,char*,int, int);
 // swtch.S
 void            swtch(struct context**, struct context*);
 
+// slab.c
+void            slabinit(void);
+void            kmem_cache_init(struct kmem_cache*, char*, uint);
+void*           kmem_cache_alloc(struct kmem_cache*);
+void            kmem_cache_free(struct kmem_cache*, void*);
+int             kmem_cache_nfree(struct kmem_cache*);
+int             get_slabinfo_file_string(char*);
+
 // spinlock.c
 void            acquire(struct spinlock*);
 void            getcallerpcs(void*, uint*);
@@ -160,6 +234,7 @@ char*           itoa (int, char*);
 // syscall.c
 int             argint(int, int*);
 int             argptr(int, char**, int);
+int             argbuf(int, char**, int);
 int             argstr(int, char**);
 int             fetchint(uint, int*);
 int             fetchstr(uint, char**);
@@ -183,7 +258,10 @@ void            uartputc(int);
 void            seginit(void);
 void            kvmalloc(void);
 pde_t*          setupkvm(void);
+pte_t*          walkpgdir(pde_t*, const void*, int);
+int             mappages(pde_t*, void*, uint, uint, int);
 char*           uva2ka(pde_t*, char*);
+char*           uswappage(pde_t*, char*, char*);
 int             allocuvm(pde_t*, uint, uint);
 int             deallocuvm(pde_t*, uint, uint);
 void            freevm(pde_t*);
@@ -193,6 +271,9 @@ pde_t*          copyuvm(pde_t*, uint);
 void            switchuvm(struct proc*);
 void            switchkvm(void);
 int             copyout(pde_t*, uint, void*, uint);
+int             ucopyin(void*, char*, uint);
+int             ucopyout(char*, void*, uint);
+uint            extable_fixup(uint);
 void            clearpteu(pde_t *pgdir, char *uva);
 
 // number of elements in fixed-size array
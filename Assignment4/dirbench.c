@@ -0,0 +1,75 @@
+// Directory benchmark: creates NFILES empty files in one
+// directory, opens each of them again by name and then unlinks
+// them, reporting the ticks each pass takes. With the hashed
+// directory index each lookup reads a chain of a block or two
+// instead of the whole directory.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+
+#define NFILES 5000
+
+char path[] = "dirbench/f0000";
+
+// Set the file name in path to number i.
+void
+name(int i)
+{
+  int j;
+
+  for(j = 13; j >= 10; j--){
+    path[j] = '0' + i % 10;
+    i /= 10;
+  }
+}
+
+int
+main(int argc, char *argv[])
+{
+  int fd, i, start, tcreate, tlookup, tunlink;
+
+  if(mkdir("dirbench") < 0){
+    printf(1, "dirbench: mkdir failed\n");
+    exit();
+  }
+
+  start = uptime();
+  for(i = 0; i < NFILES; i++){
+    name(i);
+    if((fd = open(path, O_CREATE | O_RDWR)) < 0){
+      printf(1, "dirbench: cannot create %s\n", path);
+      exit();
+    }
+    close(fd);
+  }
+  tcreate = uptime() - start;
+
+  start = uptime();
+  for(i = 0; i < NFILES; i++){
+    name(i);
+    if((fd = open(path, O_RDONLY)) < 0){
+      printf(1, "dirbench: cannot open %s\n", path);
+      exit();
+    }
+    close(fd);
+  }
+  tlookup = uptime() - start;
+
+  start = uptime();
+  for(i = 0; i < NFILES; i++){
+    name(i);
+    if(unlink(path) < 0){
+      printf(1, "dirbench: cannot unlink %s\n", path);
+      exit();
+    }
+  }
+  tunlink = uptime() - start;
+
+  if(unlink("dirbench") < 0)
+    printf(1, "dirbench: cannot remove dirbench\n");
+  printf(1, "dirbench: %d files: create %d ticks, lookup %d ticks, unlink %d ticks\n",
+         NFILES, tcreate, tlookup, tunlink);
+  exit();
+}
@@ -59,6 +59,8 @@ exec(char *path, char **argv)
   iunlockput(ip);
   end_op();
   ip = 0;
+  if(sz >= MMAPBASE)
+    goto bad;
 
   // Allocate two pages at the next page boundary.
   // Make the first inaccessible.  Use the second as the user stack.
@@ -94,6 +96,7 @@ exec(char *path, char **argv)
   safestrcpy(curproc->name, last, sizeof(curproc->name));
 
   // Commit to the user image.
+  vmafree(curproc);
   oldpgdir = curproc->pgdir;
   curproc->pgdir = pgdir;
   curproc->sz = sz;
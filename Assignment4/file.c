@@ -5,76 +5,67 @@
 #include "types.h"
 #include "defs.h"
 #include "param.h"
+#include "stat.h"
 #include "fs.h"
 #include "spinlock.h"
 #include "sleeplock.h"
 #include "file.h"
+#include "slab.h"
+#include "uio.h"
 
 struct devsw devsw[NDEV];
+// Open files come from a slab cache, so there is no fixed limit
+// on their number; ftable.list links them for /proc/filestat.
 struct {
   struct spinlock lock;
-  struct file file[NFILE];
+  struct kmem_cache cache;
+  struct file *list;
 } ftable;
 
 void
 fileinit(void)
 {
   initlock(&ftable.lock, "ftable");
+  kmem_cache_init(&ftable.cache, "file", sizeof(struct file));
 }
 
+// Is f the first open file on its inode in the list?
+// Caller holds ftable.lock.
 int
-check_if_inude_unique(int inum, int *unique_inodes){
-  // cprintf("check_if_inude_unique: inum to find: %d\n",inum);
-  int *current_inum;
-  for(current_inum = unique_inodes; current_inum < (unique_inodes + NFILE); current_inum++){
-    if(*current_inum == -1){
-      // not found in unique_inodes
-      // cprintf("not found in unique_inodes\n");
-      *current_inum = inum;
-      return 1;     
-    }
-    if(*current_inum == inum){
-      // found
-      // cprintf("found\n");
+check_if_inude_unique(struct file *f){
+  struct file *g;
+
+  for(g = ftable.list; g != f; g = g->next){
+    if(g->type == FD_INODE && g->ip == f->ip)
       return 0;
-    }
   }
-  return 0;
+  return 1;
 }
 
 
 int
 get_filestat_file_string(char* dst){
   struct file *f;
-  int unique_inodes[NFILE];
   int off = 0;
-  int free_fds = 0;
+  int free_fds = kmem_cache_nfree(&ftable.cache);
+  int used_fds = 0;
   int unique_inode_fds = 0;
   int writeable_fds = 0;  
   int readable_fds = 0; 
   int total_number_of_refs = 0;
-  int *current_inum;
-  // init unique_inodes array
-  for(current_inum = unique_inodes; current_inum < (unique_inodes + NFILE); current_inum++){
-    *current_inum = -1;
-  }
   acquire(&ftable.lock);
-  for(f = ftable.file; f < ftable.file + NFILE; f++){
-    if(f->ref == 0){
-      free_fds+=1;
+  for(f = ftable.list; f; f = f->next){
+    used_fds+=1;
+    if(f->type == FD_INODE && check_if_inude_unique(f)){
+      unique_inode_fds+=1;
     }
-    else{
-      if(check_if_inude_unique(f->ip->inum, unique_inodes)){
-        unique_inode_fds+=1;
-      }
-      if(f->readable){
-        readable_fds+=1;
-      }
-      if(f->writable){
-        writeable_fds+=1;
-      }
-      total_number_of_refs+=f->ref;
+    if(f->readable){
+      readable_fds+=1;
     }
+    if(f->writable){
+      writeable_fds+=1;
+    }
+    total_number_of_refs+=f->ref;
   }
 
   char free_fds_str[] = "Free fds: ";
@@ -86,11 +77,7 @@ get_filestat_file_string(char* dst){
   char readable_fds_str[] = "Readable fds: "; 
   off+=add_string_number(dst,off,readable_fds_str,readable_fds,add_space);
   char refs_per_fds_str[] = "Refs per fds: "; 
-  int used_fds = 100 - free_fds;
-  // cprintf("used_fds: %d\n",used_fds);
-  // cprintf("total_number_of_refs: %d\n",total_number_of_refs);
-
-  float refs_per_fds = (float)total_number_of_refs/(float)used_fds;
+  int refs_per_fds = used_fds ? total_number_of_refs/used_fds : 0;
   off+=add_string_number(dst,off,refs_per_fds_str,refs_per_fds,add_space);
   release(&ftable.lock);
   return off;
@@ -102,16 +89,17 @@ filealloc(void)
 {
   struct file *f;
 
+  if((f = kmem_cache_alloc(&ftable.cache)) == 0)
+    return 0;
+  memset(f, 0, sizeof(*f));
+  f->ref = 1;
   acquire(&ftable.lock);
-  for(f = ftable.file; f < ftable.file + NFILE; f++){
-    if(f->ref == 0){
-      f->ref = 1;
-      release(&ftable.lock);
-      return f;
-    }
-  }
+  f->next = ftable.list;
+  if(ftable.list)
+    ftable.list->prev = f;
+  ftable.list = f;
   release(&ftable.lock);
-  return 0;
+  return f;
 }
 
 // Increment ref count for file f.
@@ -142,7 +130,14 @@ fileclose(struct file *f)
   ff = *f;
   f->ref = 0;
   f->type = FD_NONE;
+  if(f->prev)
+    f->prev->next = f->next;
+  else
+    ftable.list = f->next;
+  if(f->next)
+    f->next->prev = f->prev;
   release(&ftable.lock);
+  kmem_cache_free(&ftable.cache, f);
 
   if(ff.type == FD_PIPE)
     pipeclose(ff.pipe, ff.writable);
@@ -166,37 +161,148 @@ filestat(struct file *f, struct stat *st)
   return -1;
 }
 
-// Read from file f.
+// Write what was written to file f to disk, and wait until it
+// and everything else written so far is committed.
 int
-fileread(struct file *f, char *addr, int n)
+filesync(struct file *f)
+{
+  if(f->type != FD_INODE)
+    return -1;
+  iflush(f->ip);
+  log_sync();
+  return 0;
+}
+
+// A read of n bytes at off from f just finished. If it went on
+// where the last read stopped, keep the next rawin blocks on
+// their way from the disk, and double the window each time
+// the reader gets through half of it; any other read resets
+// the window. Caller must hold f->ip->lock.
+static void
+readahead(struct file *f, uint off, uint n)
 {
-  int r;
+  uint start;
+
+  if(off != f->rapos){
+    f->rawin = 0;
+    f->raend = 0;
+    f->rapos = off + n;
+    return;
+  }
+  f->rapos = off + n;
+  if(f->rawin == 0)
+    f->rawin = RAMIN < bcachesize()/4 ? RAMIN : bcachesize()/4;
+  if(f->rapos + f->rawin*BSIZE/2 < f->raend)
+    return;  // plenty on its way still
+  start = f->raend > f->rapos ? f->raend : f->rapos;
+  f->raend = f->rapos + f->rawin*BSIZE;
+  ireadahead(f->ip, start, f->raend - start);
+  // A window must leave most buffers free for everyone else.
+  if(f->rawin < RAMAX && f->rawin*2 <= bcachesize()/4)
+    f->rawin *= 2;
+}
+
+// Read from file f into the cnt buffers of iov, at offset off,
+// or at f->off (which advances) if off is -1.
+int
+filereadv(struct file *f, struct iovec *iov, int cnt, int off)
+{
+  uint pos, start;
+  int i, r, tot;
 
   if(f->readable == 0)
     return -1;
-  if(f->type == FD_PIPE)
-    return piperead(f->pipe, addr, n);
+  tot = 0;
+  if(f->type == FD_PIPE){
+    if(off != -1)
+      return -1;
+    for(i = 0; i < cnt; i++){
+      // Wait for data only for the first buffer.
+      if((r = piperead(f->pipe, iov[i].iov_base, iov[i].iov_len, i == 0)) < 0)
+        return tot > 0 ? tot : -1;
+      tot += r;
+      if(r < iov[i].iov_len)
+        break;
+    }
+    return tot;
+  }
   if(f->type == FD_INODE){
     ilock(f->ip);
-    if((r = readi(f->ip, addr, f->off, n)) > 0)
-      f->off += r;
+    pos = off == -1 ? f->off : off;
+    start = pos;
+    for(i = 0; i < cnt; i++){
+      if((r = ureadi(f->ip, iov[i].iov_base, pos, iov[i].iov_len)) < 0){
+        if(tot == 0)
+          tot = -1;
+        break;
+      }
+      pos += r;
+      tot += r;
+      if(r < iov[i].iov_len)
+        break;
+    }
+    if(off == -1)
+      f->off = pos;
+    if(tot > 0)
+      readahead(f, start, tot);
     iunlock(f->ip);
-    return r;
+    return tot;
   }
   panic("fileread");
 }
 
+// Read from file f.
+int
+fileread(struct file *f, char *addr, int n)
+{
+  struct iovec iov;
+
+  iov.iov_base = addr;
+  iov.iov_len = n;
+  return filereadv(f, &iov, 1, -1);
+}
+
 //PAGEBREAK!
-// Write to file f.
+// Write the cnt buffers of iov to file f, at offset off, or at
+// f->off (which advances) if off is -1.
 int
-filewrite(struct file *f, char *addr, int n)
+filewritev(struct file *f, struct iovec *iov, int cnt, int off)
 {
-  int r;
+  uint pos;
+  int i, n, r, tot, done, room;
 
   if(f->writable == 0)
     return -1;
-  if(f->type == FD_PIPE)
-    return pipewrite(f->pipe, addr, n);
+  n = 0;
+  for(i = 0; i < cnt; i++)
+    n += iov[i].iov_len;
+  if(f->type == FD_PIPE){
+    if(off != -1)
+      return -1;
+    for(i = 0; i < cnt; i++)
+      if(pipewrite(f->pipe, iov[i].iov_base, iov[i].iov_len, 0) < 0)
+        return -1;
+    return n;
+  }
+  if(f->type == FD_INODE && f->ip->type == T_FILE){
+    // File data only goes to the page cache, to be written back
+    // later (see iflush() in fs.c), so no transaction is needed.
+    tot = 0;
+    ilock(f->ip);
+    pos = off == -1 ? f->off : off;
+    for(i = 0; i < cnt; i++){
+      if((r = uwritei(f->ip, iov[i].iov_base, pos, iov[i].iov_len)) < 0)
+        break;
+      pos += r;
+      tot += r;
+    }
+    if(off == -1)
+      f->off = pos;
+    iunlock(f->ip);
+    if(pdirtyfull())
+      iflush(f->ip);
+    return i == cnt ? tot : -1;
+  }
   if(f->type == FD_INODE){
     // write a few blocks at a time to avoid exceeding
     // the maximum log transaction size, including
@@ -204,28 +310,53 @@ filewrite(struct file *f, char *addr, int n)
     // and 2 blocks of slop for non-aligned writes.
     // this really belongs lower down, since writei()
     // might be writing a device like the console.
+    // Small buffers are gathered into one transaction
+    // until it has max bytes.
     int max = ((MAXOPBLOCKS-1-1-2) / 2) * 512;
-    int i = 0;
-    while(i < n){
-      int n1 = n - i;
-      if(n1 > max)
-        n1 = max;
-
+    tot = 0;
+    done = 0;  // bytes of iov[i] written
+    r = 0;
+    i = 0;
+    pos = off;
+    while(i < cnt && r >= 0){
       begin_op();
       ilock(f->ip);
-      if ((r = writei(f->ip, addr + i, f->off, n1)) > 0)
-        f->off += r;
+      if(off == -1)
+        pos = f->off;
+      for(room = max; room > 0 && i < cnt; ){
+        n = iov[i].iov_len - done;
+        if(n > room)
+          n = room;
+        if((r = uwritei(f->ip, (char*)iov[i].iov_base + done, pos, n)) < 0)
+          break;
+        if(r != n)
+          panic("short filewrite");
+        pos += r;
+        tot += r;
+        room -= r;
+        if((done += r) == iov[i].iov_len){
+          i++;
+          done = 0;
+        }
+      }
+      if(off == -1)
+        f->off = pos;
       iunlock(f->ip);
       end_op();
-
-      if(r < 0)
-        break;
-      if(r != n1)
-        panic("short filewrite");
-      i += r;
     }
-    return i == n ? n : -1;
+    return i == cnt ? tot : -1;
   }
   panic("filewrite");
 }
 
+// Write to file f.
+int
+filewrite(struct file *f, char *addr, int n)
+{
+  struct iovec iov;
+
+  iov.iov_base = addr;
+  iov.iov_len = n;
+  return filewritev(f, &iov, 1, -1);
+}
+
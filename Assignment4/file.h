@@ -6,6 +6,11 @@ struct file {
   struct pipe *pipe;
   struct inode *ip;
   uint off;
+  uint rapos;         // where a sequential read would go on
+  uint raend;         // end of what has been read ahead
+  uint rawin;         // readahead window, in blocks
+  struct file *next;  // list of open files
+  struct file *prev;
 };
 
 
@@ -22,7 +27,21 @@ struct inode {
   short minor;
   short nlink;
   uint size;
-  uint addrs[NDIRECT+1];
+  uint addrs[NDIRECT+3];
+
+  uint ext_bn;        // extent cache: file blocks ext_bn..
+  uint ext_start;     // ..ext_bn+ext_len-1 are disk blocks
+  uint ext_len;       // ext_start.., found by the last bmap
+  uint ranext;        // page a sequential reader wants next
+
+  uint dsize;         // a file's size as far as it has disk blocks
+  uint dlo;           // pages dlo..dhi-1 may be dirty (none if dhi is 0)
+  uint dhi;
+  int dirty;          // on the flush queue; protected by flushq.lock
+  struct inode *dnext;
+
+  struct inode *prev; // LRU list of the icache bucket
+  struct inode *next;
 };
 
 // table mapping major device number to
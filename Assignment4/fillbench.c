@@ -0,0 +1,105 @@
+// Allocator benchmark: fills the disk to 10%, 50% and 90% with
+// large files and at each level times creating small files and
+// appending to a large one, to show how block allocation holds
+// up as the disk fills. Fill levels come from /proc/fsinfo.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fs.h"
+#include "fcntl.h"
+
+#define NCREATE 30      // small files created per level
+#define NAPPEND 256     // blocks appended per level
+#define FILLMAX 4096    // blocks per filler file
+#define CHUNK   8       // blocks per write
+
+char data[CHUNK*BSIZE];
+
+void
+name(char *path, char c, int i)
+{
+  path[0] = c;
+  path[1] = 'b';
+  path[2] = '0' + (i / 10) % 10;
+  path[3] = '0' + i % 10;
+  path[4] = 0;
+}
+
+// Write nblocks blocks to the end of path.
+int
+append(char *path, int nblocks)
+{
+  int fd, n;
+
+  if((fd = open(path, O_CREATE | O_RDWR)) < 0)
+    return -1;
+  while(nblocks > 0){
+    n = nblocks < CHUNK ? nblocks : CHUNK;
+    if(write(fd, data, n * BSIZE) != n * BSIZE){
+      close(fd);
+      return -1;
+    }
+    nblocks -= n;
+  }
+  close(fd);
+  return 0;
+}
+
+int
+main(int argc, char *argv[])
+{
+  static int levels[] = { 10, 50, 90 };
+  int total, used, want, nfill, i, l, start, tcreate, tappend;
+  char path[8];
+
+  if((total = procinfo("/proc/fsinfo", "Data blocks: ")) < 0){
+    printf(1, "fillbench: cannot read /proc/fsinfo\n");
+    exit();
+  }
+  memset(data, 'f', sizeof(data));
+  nfill = 0;
+
+  for(l = 0; l < sizeof(levels)/sizeof(levels[0]); l++){
+    // Fill up to the level, a filler file at a time.
+    want = total * levels[l] / 100;
+    while((used = total - procinfo("/proc/fsinfo", "Free blocks: ")) < want){
+      name(path, 'f', nfill++);
+      if(append(path, want - used < FILLMAX ? want - used : FILLMAX) < 0){
+        printf(1, "fillbench: cannot fill %s\n", path);
+        exit();
+      }
+    }
+
+    start = uptime();
+    for(i = 0; i < NCREATE; i++){
+      name(path, 'c', i);
+      if(append(path, 1) < 0){
+        printf(1, "fillbench: cannot create %s\n", path);
+        exit();
+      }
+    }
+    tcreate = uptime() - start;
+
+    start = uptime();
+    if(append("ab", NAPPEND) < 0){
+      printf(1, "fillbench: cannot append\n");
+      exit();
+    }
+    tappend = uptime() - start;
+
+    for(i = 0; i < NCREATE; i++){
+      name(path, 'c', i);
+      unlink(path);
+    }
+    unlink("ab");
+    printf(1, "fillbench: %d%% full: %d creates in %d ticks, %d blocks appended in %d ticks\n",
+           levels[l], NCREATE, tcreate, NAPPEND, tappend);
+  }
+
+  for(i = 0; i < nfill; i++){
+    name(path, 'f', i);
+    unlink(path);
+  }
+  exit();
+}
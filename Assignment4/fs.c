@@ -23,6 +23,9 @@
 
 #define min(a, b) ((a) < (b) ? (a) : (b))
 static void itrunc(struct inode*);
+static void dcinit(void);
+static void dcforget(uint, uint);
+static void flushinit(void);
 // there should be one superblock per disk device, but we run with
 // only one device
 struct superblock sb; 
@@ -51,28 +54,87 @@ bzero(int dev, int bno)
 }
 
 // Blocks.
+//
+// The disk is split into block groups, each with its own free
+// map block and inode blocks. groups keeps a summary of each
+// group in memory: how many blocks and inodes it has free and
+// where the next search for one should start (next fit), so
+// that allocation skips full groups without reading their
+// maps, and does not rescan the start of a group that filled
+// up long ago.
+
+struct group {
+  int nbfree;   // Free data blocks
+  uint bhint;   // Block to start the next search at
+  int nifree;   // Free inodes
+  uint ihint;   // Inode to start the next search at
+};
+
+struct {
+  struct spinlock lock;
+  struct group g[MAXGROUPS];
+} groups;
 
-// Allocate a zeroed disk block.
+// Allocate the first free block in [from, to), all within
+// one group, or return 0.
 static uint
-balloc(uint dev)
+bscan(uint dev, uint from, uint to)
 {
-  int b, bi, m;
+  uint b, bi, m;
   struct buf *bp;
 
-  bp = 0;
-  for(b = 0; b < sb.size; b += BPB){
-    bp = bread(dev, BBLOCK(b, sb));
-    for(bi = 0; bi < BPB && b + bi < sb.size; bi++){
-      m = 1 << (bi % 8);
-      if((bp->data[bi/8] & m) == 0){  // Is block free?
-        bp->data[bi/8] |= m;  // Mark block in use.
-        log_write(bp);
-        brelse(bp);
-        bzero(dev, b + bi);
-        return b + bi;
-      }
+  if(from >= to)
+    return 0;
+  bp = bread(dev, BBLOCK(from, sb));
+  for(b = from; b < to; b++){
+    bi = BBIT(b, sb);
+    if(bi % 8 == 0 && bp->data[bi/8] == 0xff && b + 8 <= to){
+      b += 7;  // skip a full byte
+      continue;
+    }
+    m = 1 << (bi % 8);
+    if((bp->data[bi/8] & m) == 0){  // Is block free?
+      bp->data[bi/8] |= m;  // Mark block in use.
+      log_write(bp);
+      brelse(bp);
+      return b;
+    }
+  }
+  brelse(bp);
+  return 0;
+}
+
+// Allocate a zeroed disk block: the first free block at or
+// after goal in goal's group, so that a file given the block
+// after its last one as goal grows in a contiguous run. If
+// that group is full, take the next group that is not,
+// starting at its hint.
+static uint
+balloc(uint dev, uint goal)
+{
+  uint b, g, g0, i, from, to;
+  int n;
+
+  if(goal < sb.groupstart || goal >= sb.size)
+    goal = sb.groupstart;
+  g0 = BGROUP(goal, sb);
+  for(i = 0; i < sb.ngroups; i++){
+    g = (g0 + i) % sb.ngroups;
+    acquire(&groups.lock);
+    n = groups.g[g].nbfree;
+    from = i == 0 ? goal : groups.g[g].bhint;
+    release(&groups.lock);
+    if(n == 0)
+      continue;
+    to = min(GSTART(g+1, sb), sb.size);
+    if((b = bscan(dev, from, to)) != 0 || (b = bscan(dev, GSTART(g, sb), from)) != 0){
+      acquire(&groups.lock);
+      groups.g[g].nbfree--;
+      groups.g[g].bhint = b + 1 < to ? b + 1 : GSTART(g, sb);
+      release(&groups.lock);
+      bzero(dev, b);
+      return b;
     }
-    brelse(bp);
   }
   panic("balloc: out of blocks");
 }
@@ -84,15 +146,94 @@ bfree(int dev, uint b)
   struct buf *bp;
   int bi, m;
 
-  readsb(dev, &sb);
   bp = bread(dev, BBLOCK(b, sb));
-  bi = b % BPB;
+  bi = BBIT(b, sb);
   m = 1 << (bi % 8);
   if((bp->data[bi/8] & m) == 0)
     panic("freeing free block");
   bp->data[bi/8] &= ~m;
   log_write(bp);
   brelse(bp);
+  acquire(&groups.lock);
+  groups.g[BGROUP(b, sb)].nbfree++;
+  release(&groups.lock);
+}
+
+// Count the free blocks and inodes of every group.
+static void
+ginit(int dev)
+{
+  struct buf *bp;
+  struct dinode *dip;
+  struct group *g;
+  uint i, j, b, inum;
+
+  initlock(&groups.lock, "groups");
+  if(sb.ngroups > MAXGROUPS)
+    panic("ginit: too many groups");
+  for(i = 0; i < sb.ngroups; i++){
+    g = &groups.g[i];
+    g->bhint = GDATA(i, sb);
+    g->ihint = i * sb.ipg;
+    bp = bread(dev, GSTART(i, sb));
+    for(b = GDATA(i, sb); b < min(GSTART(i+1, sb), sb.size); b++)
+      if((bp->data[BBIT(b, sb)/8] & (1 << (BBIT(b, sb)%8))) == 0)
+        g->nbfree++;
+    brelse(bp);
+    for(inum = i * sb.ipg; inum < (i+1) * sb.ipg; inum += IPB){
+      bp = bread(dev, IBLOCK(inum, sb));
+      dip = (struct dinode*)bp->data;
+      for(j = 0; j < IPB; j++)
+        if(dip[j].type == 0 && inum + j != 0)  // inode 0 is never used
+          g->nifree++;
+      brelse(bp);
+    }
+  }
+}
+
+// Free block of the group holding ip, to allocate its blocks near.
+static uint
+igoal(struct inode *ip)
+{
+  uint goal;
+
+  acquire(&groups.lock);
+  goal = groups.g[IGROUP(ip->inum, sb)].bhint;
+  release(&groups.lock);
+  return goal;
+}
+
+int
+get_fsinfo_file_string(char* dst)
+{
+  int off = 0;
+  int i, nbfree = 0, nifree = 0;
+
+  acquire(&groups.lock);
+  for(i = 0; i < sb.ngroups; i++){
+    nbfree += groups.g[i].nbfree;
+    nifree += groups.g[i].nifree;
+  }
+  char blocks_str[] = "Data blocks: ";
+  off+=add_string_number(dst,off,blocks_str,sb.nblocks,add_space);
+  char bfree_str[] = "Free blocks: ";
+  off+=add_string_number(dst,off,bfree_str,nbfree,add_space);
+  char inodes_str[] = "Inodes: ";
+  off+=add_string_number(dst,off,inodes_str,sb.ninodes-1,add_space);
+  char ifree_str[] = "Free inodes: ";
+  off+=add_string_number(dst,off,ifree_str,nifree,add_space);
+  char groups_str[] = "Groups: ";
+  off+=add_string_number(dst,off,groups_str,sb.ngroups,add_space);
+  for(i = 0; i < sb.ngroups; i++){
+    char group_str[] = "Group ";
+    off+=add_string_number(dst,off,group_str,i,no_space);
+    char gbfree_str[] = ": free blocks ";
+    off+=add_string_number(dst,off,gbfree_str,groups.g[i].nbfree,no_space);
+    char gifree_str[] = ", free inodes ";
+    off+=add_string_number(dst,off,gifree_str,groups.g[i].nifree,add_space);
+  }
+  release(&groups.lock);
+  return off;
 }
 
 // Inodes.
@@ -102,9 +243,9 @@ bfree(int dev, uint b)
 // its size, the number of links referring to it, and the
 // list of blocks holding the file's content.
 //
-// The inodes are laid out sequentially on disk at
-// sb.startinode. Each inode has a number, indicating its
-// position on the disk.
+// The inodes are laid out sequentially on disk, sb.ipg
+// of them at the start of each block group. Each inode has
+// a number, indicating its position on the disk.
 //
 // The kernel keeps a cache of in-use inodes in memory
 // to provide a place for synchronizing access
@@ -155,74 +296,206 @@ bfree(int dev, uint b)
 // have locked the inodes involved; this lets callers create
 // multi-step atomic operations.
 //
-// The icache.lock spin-lock protects the allocation of icache
-// entries. Since ip->ref indicates whether an entry is free,
-// and ip->dev and ip->inum indicate which i-node an entry
-// holds, one must hold icache.lock while using any of those fields.
+// The icache is a hash table of NIBUCKET buckets. Each bucket
+// has a spin-lock and an LRU list of the entries for the
+// inodes that hash to it. Since ip->ref indicates whether an
+// entry is in use, and ip->dev and ip->inum indicate which
+// i-node an entry holds, one must hold the lock of the entry's
+// bucket while using any of those fields. Entries whose ref
+// has fallen to zero stay in their bucket, still valid, so that
+// iget() of a recently used inode does not read it again; a
+// miss recycles the least recently used of them. icache.lock
+// is only taken on a miss, to serialize recycling between
+// buckets. Lock order: icache.lock, then the bucket the inode
+// hashes to, then at most one other bucket.
+//
+// The entries themselves are allocated by iinit() from the
+// free page pool, so the size of the cache follows the amount
+// of physical memory.
 //
 // An ip->lock sleep-lock protects all ip-> fields other than ref,
 // dev, and inum.  One must hold ip->lock in order to
 // read or write that inode's ip->valid, ip->size, ip->type, &c.
 
+#define IHASH(dev, inum) (((dev)*31 + (inum)) % NIBUCKET)
+
+struct ibucket {
+  struct spinlock lock;
+  struct inode *head;  // most recently used; head->prev is least
+  uint lookups;
+  uint hits;
+};
+
 struct {
   struct spinlock lock;
-  struct inode inode[NINODE];
+  struct inode *inode[NINODEMAX];  // all ninode entries
+  struct inode *free;  // never used entries, through next
+  int ninode;
+  int steal;           // next bucket to take an entry from
+  uint evictions;
+  struct ibucket bucket[NIBUCKET];
 } icache;
 
-struct inode*
-get_ip_from_icache_index(int inode_index_in_icache, int in_inodeinfo_directory){  
-  if(in_inodeinfo_directory){
-    if(icache.inode[inode_index_in_icache].ref>0){
-      return &icache.inode[inode_index_in_icache];
-    }    
+// Remove ip from the LRU list of bk.
+static void
+iunlink(struct ibucket *bk, struct inode *ip)
+{
+  if(ip->next == ip){
+    bk->head = 0;
+    return;
   }
-  else{
-    return &icache.inode[inode_index_in_icache];
+  ip->next->prev = ip->prev;
+  ip->prev->next = ip->next;
+  if(bk->head == ip)
+    bk->head = ip->next;
+}
+
+// Make ip the most recently used entry of bk.
+static void
+ipush(struct ibucket *bk, struct inode *ip)
+{
+  if(bk->head == 0){
+    ip->next = ip;
+    ip->prev = ip;
+  } else {
+    ip->next = bk->head;
+    ip->prev = bk->head->prev;
+    bk->head->prev->next = ip;
+    bk->head->prev = ip;
   }
-  return 0;
+  bk->head = ip;
+}
+
+// Return entry i of the cache, or 0 if there is none; if
+// in_inodeinfo_directory is set, only if it is in use.
+struct inode*
+get_ip_from_icache_index(int inode_index_in_icache, int in_inodeinfo_directory){  
+  struct inode *ip;
+
+  if(inode_index_in_icache < 0 || inode_index_in_icache >= icache.ninode)
+    return 0;
+  ip = icache.inode[inode_index_in_icache];
+  if(in_inodeinfo_directory && ip->ref == 0)
+    return 0;
+  return ip;
 }
 
+// Must be called after kinit2(), since the entries
+// come from the page allocator.
 void
 iinit(int dev)
 {
-  int i = 0;
-  
+  struct inode *ip;
+  char *page;
+  int i, n, perpage;
+
   initlock(&icache.lock, "icache");
-  for(i = 0; i < NINODE; i++) {
-    initsleeplock(&icache.inode[i].lock, "inode");
+  for(i = 0; i < NIBUCKET; i++)
+    initlock(&icache.bucket[i].lock, "icache.bucket");
+
+  perpage = PGSIZE / sizeof(struct inode);
+  n = kfreecount() / ICACHEFRAC * perpage;
+  if(n > NINODEMAX)
+    n = NINODEMAX;
+  if(n < NINODE)
+    n = NINODE;
+  while(icache.ninode < n){
+    if((page = kalloc()) == 0)
+      panic("iinit");
+    for(ip = (struct inode*)page; ip < (struct inode*)page + perpage && icache.ninode < n; ip++){
+      memset(ip, 0, sizeof(*ip));
+      initsleeplock(&ip->lock, "inode");
+      ip->next = icache.free;
+      icache.free = ip;
+      icache.inode[icache.ninode++] = ip;
+    }
   }
+  cprintf("icache: %d inodes, %d buckets\n", icache.ninode, NIBUCKET);
 
   readsb(dev, &sb);
   cprintf("sb: size %d nblocks %d ninodes %d nlog %d logstart %d\
- inodestart %d bmap start %d\n", sb.size, sb.nblocks,
-          sb.ninodes, sb.nlog, sb.logstart, sb.inodestart,
-          sb.bmapstart);
+ groups %d of %d blocks, %d inodes\n", sb.size, sb.nblocks,
+          sb.ninodes, sb.nlog, sb.logstart, sb.ngroups,
+          sb.bpg, sb.ipg);
+  ginit(dev);
+  dcinit();
+  flushinit();
 }
 
 static struct inode* iget(uint dev, uint inum);
 
 //PAGEBREAK!
-// Allocate an inode on device dev.
-// Mark it as allocated by  giving it type type.
-// Returns an unlocked but allocated and referenced inode.
-struct inode*
-ialloc(uint dev, short type)
+// Allocate a free inode in [from, to), all within one group,
+// giving it type type, or return 0.
+static uint
+iscan(uint dev, short type, uint from, uint to)
 {
-  int inum;
+  uint inum;
   struct buf *bp;
   struct dinode *dip;
 
-  for(inum = 1; inum < sb.ninodes; inum++){
-    bp = bread(dev, IBLOCK(inum, sb));
+  bp = 0;
+  for(inum = from; inum < to; inum++){
+    if(inum == 0)
+      continue;
+    if(bp == 0 || inum % IPB == 0){
+      if(bp)
+        brelse(bp);
+      bp = bread(dev, IBLOCK(inum, sb));
+    }
     dip = (struct dinode*)bp->data + inum%IPB;
     if(dip->type == 0){  // a free inode
       memset(dip, 0, sizeof(*dip));
       dip->type = type;
       log_write(bp);   // mark it allocated on the disk
       brelse(bp);
-      return iget(dev, inum);
+      return inum;
     }
+  }
+  if(bp)
     brelse(bp);
+  return 0;
+}
+
+// Allocate an inode on device dev.
+// Mark it as allocated by  giving it type type.
+// A file goes in the group of the directory near that will
+// hold it, so that a directory and its files share a group; a
+// new directory goes in the group with the most free blocks,
+// to spread directory trees out over the disk.
+// Returns an unlocked but allocated and referenced inode.
+struct inode*
+ialloc(uint dev, short type, uint near)
+{
+  uint inum, g, g0, i, from, start;
+  int n;
+
+  g0 = IGROUP(near, sb);
+  if(type == T_DIR){
+    acquire(&groups.lock);
+    for(g = 0; g < sb.ngroups; g++)
+      if(groups.g[g].nifree > 0 &&
+         groups.g[g].nbfree > groups.g[g0].nbfree)
+        g0 = g;
+    release(&groups.lock);
+  }
+  for(i = 0; i < sb.ngroups; i++){
+    g = (g0 + i) % sb.ngroups;
+    acquire(&groups.lock);
+    n = groups.g[g].nifree;
+    from = groups.g[g].ihint;
+    release(&groups.lock);
+    if(n == 0)
+      continue;
+    start = g * sb.ipg;
+    if((inum = iscan(dev, type, from, start + sb.ipg)) != 0 ||
+       (inum = iscan(dev, type, start, from)) != 0){
+      acquire(&groups.lock);
+      groups.g[g].nifree--;
+      groups.g[g].ihint = inum + 1 < start + sb.ipg ? inum + 1 : start;
+      release(&groups.lock);
+      return iget(dev, inum);
+    }
   }
   panic("ialloc: no inodes");
 }
@@ -243,45 +516,121 @@ iupdate(struct inode *ip)
   dip->major = ip->major;
   dip->minor = ip->minor;
   dip->nlink = ip->nlink;
-  dip->size = ip->size;
+  // A file's data past dsize has no blocks yet (see iflush()),
+  // so the disk inode must not claim it.
+  dip->size = ip->type == T_FILE ? ip->dsize : ip->size;
   memmove(dip->addrs, ip->addrs, sizeof(ip->addrs));
   log_write(bp);
   brelse(bp);
 }
 
+// Look for the inode in bk. Caller holds bk->lock.
+static struct inode*
+ifind(struct ibucket *bk, uint dev, uint inum)
+{
+  struct inode *ip;
+
+  if((ip = bk->head) == 0)
+    return 0;
+  do {
+    if(ip->dev == dev && ip->inum == inum)
+      return ip;
+    ip = ip->next;
+  } while(ip != bk->head);
+  return 0;
+}
+
+// Take the least recently used unreferenced entry of bk off
+// its list. Caller holds bk->lock.
+static struct inode*
+itake(struct ibucket *bk)
+{
+  struct inode *ip;
+
+  if(bk->head == 0)
+    return 0;
+  ip = bk->head->prev;
+  do {
+    if(ip->ref == 0){
+      iunlink(bk, ip);
+      return ip;
+    }
+    ip = ip->prev;
+  } while(ip != bk->head->prev);
+  return 0;
+}
+
+// Find an entry to recycle for an inode that hashes to bk.
+// Caller holds icache.lock and bk->lock.
+static struct inode*
+ievict(struct ibucket *bk)
+{
+  struct ibucket *other;
+  struct inode *ip;
+  int i;
+
+  if((ip = icache.free) != 0){
+    icache.free = ip->next;
+    return ip;
+  }
+  icache.evictions++;
+  if((ip = itake(bk)) != 0)
+    return ip;
+  for(i = 0; i < NIBUCKET; i++){
+    other = &icache.bucket[icache.steal];
+    icache.steal = (icache.steal + 1) % NIBUCKET;
+    if(other == bk)
+      continue;
+    acquire(&other->lock);
+    ip = itake(other);
+    release(&other->lock);
+    if(ip)
+      return ip;
+  }
+  return 0;
+}
+
 // Find the inode with number inum on device dev
 // and return the in-memory copy. Does not lock
 // the inode and does not read it from disk.
 static struct inode*
 iget(uint dev, uint inum)
 {
-  struct inode *ip, *empty;
+  struct ibucket *bk;
+  struct inode *ip;
 
-  acquire(&icache.lock);
+  bk = &icache.bucket[IHASH(dev, inum)];
+  acquire(&bk->lock);
+  bk->lookups++;
 
   // Is the inode already cached?
-  empty = 0;
-  for(ip = &icache.inode[0]; ip < &icache.inode[NINODE]; ip++){
-    if(ip->ref > 0 && ip->dev == dev && ip->inum == inum){
-      ip->ref++;
-      release(&icache.lock);
-      return ip;
-    }
-    if(empty == 0 && ip->ref == 0)    // Remember empty slot.
-      empty = ip;
+  if((ip = ifind(bk, dev, inum)) != 0){
+    bk->hits++;
+    ip->ref++;
+    release(&bk->lock);
+    return ip;
   }
+  release(&bk->lock);
 
-  // Recycle an inode cache entry.
-  if(empty == 0)
-    panic("iget: no inodes");
-
-  ip = empty;
-  ip->dev = dev;
-  ip->inum = inum;
-  ip->ref = 1;
-  ip->valid = 0;
+  // Not cached; recycle an unused entry. Look again once
+  // the bucket is locked for recycling, since another process
+  // may have brought the inode in the meantime.
+  acquire(&icache.lock);
+  acquire(&bk->lock);
+  if((ip = ifind(bk, dev, inum)) != 0){
+    bk->hits++;
+    ip->ref++;
+  } else {
+    if((ip = ievict(bk)) == 0)
+      panic("iget: no inodes");
+    ip->dev = dev;
+    ip->inum = inum;
+    ip->ref = 1;
+    ip->valid = 0;
+    ipush(bk, ip);
+  }
+  release(&bk->lock);
   release(&icache.lock);
-
   return ip;
 }
 
@@ -290,9 +639,11 @@ iget(uint dev, uint inum)
 struct inode*
 idup(struct inode *ip)
 {
-  acquire(&icache.lock);
+  struct ibucket *bk = &icache.bucket[IHASH(ip->dev, ip->inum)];
+
+  acquire(&bk->lock);
   ip->ref++;
-  release(&icache.lock);
+  release(&bk->lock);
   return ip;
 }
 
@@ -319,6 +670,10 @@ ilock(struct inode *ip)
     ip->size = dip->size;
     memmove(ip->addrs, dip->addrs, sizeof(ip->addrs));
     brelse(bp);
+    ip->ext_len = 0;
+    ip->ranext = 0;
+    ip->dsize = ip->size;
+    ip->dhi = 0;
     ip->valid = 1;
     if(ip->type == 0)
       panic("ilock: no type");
@@ -337,7 +692,7 @@ iunlock(struct inode *ip)
 
 // Drop a reference to an in-memory inode.
 // If that was the last reference, the inode cache entry can
-// be recycled.
+// be recycled, least recently used first.
 // If that was the last reference and the inode has no links
 // to it, free the inode (and its content) on disk.
 // All calls to iput() must be inside a transaction in
@@ -345,24 +700,77 @@ iunlock(struct inode *ip)
 void
 iput(struct inode *ip)
 {
+  struct ibucket *bk = &icache.bucket[IHASH(ip->dev, ip->inum)];
+
   acquiresleep(&ip->lock);
   if(ip->valid && ip->nlink == 0){
-    acquire(&icache.lock);
+    acquire(&bk->lock);
     int r = ip->ref;
-    release(&icache.lock);
+    release(&bk->lock);
     if(r == 1){
       // inode has no links and no other references: truncate and free.
       itrunc(ip);
+      if(ip->type == T_DIR)
+        dcforget(ip->dev, ip->inum);
       ip->type = 0;
       iupdate(ip);
       ip->valid = 0;
+      acquire(&groups.lock);
+      groups.g[IGROUP(ip->inum, sb)].nifree++;
+      release(&groups.lock);
     }
   }
   releasesleep(&ip->lock);
 
-  acquire(&icache.lock);
+  acquire(&bk->lock);
   ip->ref--;
-  release(&icache.lock);
+  if(ip->ref == 0){
+    iunlink(bk, ip);
+    ipush(bk, ip);
+  }
+  release(&bk->lock);
+}
+
+int
+get_icacheinfo_file_string(char* dst)
+{
+  struct ibucket *bk;
+  struct inode *ip;
+  uint lookups = 0, hits = 0;
+  int off = 0;
+  int i, used = 0, cached = 0;
+
+  for(bk = icache.bucket; bk < &icache.bucket[NIBUCKET]; bk++){
+    acquire(&bk->lock);
+    lookups += bk->lookups;
+    hits += bk->hits;
+    if((ip = bk->head) != 0){
+      do {
+        cached++;
+        if(ip->ref > 0)
+          used++;
+        ip = ip->next;
+      } while(ip != bk->head);
+    }
+    release(&bk->lock);
+  }
+  i = icache.ninode;
+
+  char inodes_str[] = "Inodes: ";
+  off+=add_string_number(dst,off,inodes_str,i,add_space);
+  char used_str[] = "In use: ";
+  off+=add_string_number(dst,off,used_str,used,add_space);
+  char cached_str[] = "Cached: ";
+  off+=add_string_number(dst,off,cached_str,cached,add_space);
+  char lookups_str[] = "Lookups: ";
+  off+=add_string_number(dst,off,lookups_str,lookups,add_space);
+  char hits_str[] = "Hits: ";
+  off+=add_string_number(dst,off,hits_str,hits,add_space);
+  char evictions_str[] = "Evictions: ";
+  off+=add_string_number(dst,off,evictions_str,icache.evictions,add_space);
+  char hit_rate_str[] = "Hit rate (%): ";
+  off+=add_string_number(dst,off,hit_rate_str,lookups ? hits*100/lookups : 0,add_space);
+  return off;
 }
 
 // Common idiom: unlock, then put.
@@ -379,19 +787,72 @@ iunlockput(struct inode *ip)
 // The content (data) associated with each inode is stored
 // in blocks on the disk. The first NDIRECT block numbers
 // are listed in ip->addrs[].  The next NINDIRECT blocks are
-// listed in block ip->addrs[NDIRECT].
+// listed in block ip->addrs[NDIRECT]. The next NDINDIRECT
+// blocks are listed in the NINDIRECT blocks listed in block
+// ip->addrs[NDIRECT+1]. A directory may also have an index
+// block, ip->addrs[DIRINDEX], which is not part of its content.
+//
+// The in-memory inode also caches one extent: the run of
+// consecutive disk blocks that the last lookup went through,
+// so that reading a file sequentially does not read the
+// indirect blocks again for every block.
+
+// Cache the run of consecutive disk blocks a[i], a[i+1], ..
+// (of the n in a) as the extent starting at file block bn.
+static void
+ext_cache(struct inode *ip, uint bn, uint *a, int i, int n)
+{
+  int len;
+
+  for(len = 1; i + len < n && a[i+len] == a[i] + len; len++)
+    ;
+  ip->ext_bn = bn;
+  ip->ext_start = a[i];
+  ip->ext_len = len;
+}
+
+// Return entry i of indirect block addr, allocating the block
+// the entry points to (near goal) if necessary. If that is a
+// data block, cache the extent that starts there as file block bn.
+static uint
+indirect(struct inode *ip, uint addr, uint i, uint goal, int leaf, uint bn)
+{
+  struct buf *bp;
+  uint *a;
+
+  bp = bread(ip->dev, addr);
+  a = (uint*)bp->data;
+  if((addr = a[i]) == 0){
+    a[i] = addr = balloc(ip->dev, goal);
+    log_write(bp);
+  }
+  if(leaf)
+    ext_cache(ip, bn, a, i, NINDIRECT);
+  brelse(bp);
+  return addr;
+}
 
 // Return the disk block address of the nth block in inode ip.
-// If there is no such block, bmap allocates one.
+// If there is no such block, bmap allocates one, next to the
+// file's previous block if that block is free, or else in the
+// block group of the inode.
 static uint
 bmap(struct inode *ip, uint bn)
 {
-  uint addr, *a;
-  struct buf *bp;
+  uint addr, goal, fbn;
+
+  if(bn - ip->ext_bn < ip->ext_len)
+    return ip->ext_start + (bn - ip->ext_bn);
+  if(bn > 0 && bn - 1 - ip->ext_bn < ip->ext_len)
+    goal = ip->ext_start + (bn - ip->ext_bn);
+  else
+    goal = igoal(ip);
+  fbn = bn;
 
   if(bn < NDIRECT){
     if((addr = ip->addrs[bn]) == 0)
-      ip->addrs[bn] = addr = balloc(ip->dev);
+      ip->addrs[bn] = addr = balloc(ip->dev, goal);
+    ext_cache(ip, fbn, ip->addrs, bn, NDIRECT);
     return addr;
   }
   bn -= NDIRECT;
@@ -399,20 +860,45 @@ bmap(struct inode *ip, uint bn)
   if(bn < NINDIRECT){
     // Load indirect block, allocating if necessary.
     if((addr = ip->addrs[NDIRECT]) == 0)
-      ip->addrs[NDIRECT] = addr = balloc(ip->dev);
-    bp = bread(ip->dev, addr);
-    a = (uint*)bp->data;
-    if((addr = a[bn]) == 0){
-      a[bn] = addr = balloc(ip->dev);
-      log_write(bp);
-    }
-    brelse(bp);
-    return addr;
+      ip->addrs[NDIRECT] = addr = balloc(ip->dev, goal);
+    return indirect(ip, addr, bn, goal, 1, fbn);
+  }
+  bn -= NINDIRECT;
+
+  if(bn < NDINDIRECT){
+    // Load double indirect block, then the indirect block.
+    if((addr = ip->addrs[NDIRECT+1]) == 0)
+      ip->addrs[NDIRECT+1] = addr = balloc(ip->dev, goal);
+    addr = indirect(ip, addr, bn / NINDIRECT, goal, 0, fbn);
+    return indirect(ip, addr, bn % NINDIRECT, goal, 1, fbn);
   }
 
   panic("bmap: out of range");
 }
 
+// Free indirect block addr and the blocks it lists, going
+// depth levels of indirection down.
+static void
+ifree(uint dev, uint addr, int depth)
+{
+  struct buf *bp;
+  uint *a;
+  int j;
+
+  bp = bread(dev, addr);
+  a = (uint*)bp->data;
+  for(j = 0; j < NINDIRECT; j++){
+    if(a[j] == 0)
+      continue;
+    if(depth > 1)
+      ifree(dev, a[j], depth - 1);
+    else
+      bfree(dev, a[j]);
+  }
+  brelse(bp);
+  bfree(dev, addr);
+}
+
 // Truncate inode (discard contents).
 // Only called when the inode has no links
 // to it (no directory entries referring to it)
@@ -421,9 +907,9 @@ bmap(struct inode *ip, uint bn)
 static void
 itrunc(struct inode *ip)
 {
-  int i, j;
-  struct buf *bp;
-  uint *a;
+  int i;
+
+  pinval(ip);
 
   for(i = 0; i < NDIRECT; i++){
     if(ip->addrs[i]){
@@ -433,18 +919,24 @@ itrunc(struct inode *ip)
   }
 
   if(ip->addrs[NDIRECT]){
-    bp = bread(ip->dev, ip->addrs[NDIRECT]);
-    a = (uint*)bp->data;
-    for(j = 0; j < NINDIRECT; j++){
-      if(a[j])
-        bfree(ip->dev, a[j]);
-    }
-    brelse(bp);
-    bfree(ip->dev, ip->addrs[NDIRECT]);
+    ifree(ip->dev, ip->addrs[NDIRECT], 1);
     ip->addrs[NDIRECT] = 0;
   }
 
+  if(ip->addrs[NDIRECT+1]){
+    ifree(ip->dev, ip->addrs[NDIRECT+1], 2);
+    ip->addrs[NDIRECT+1] = 0;
+  }
+
+  if(ip->addrs[DIRINDEX]){
+    bfree(ip->dev, ip->addrs[DIRINDEX]);
+    ip->addrs[DIRINDEX] = 0;
+  }
+
+  ip->ext_len = 0;
   ip->size = 0;
+  ip->dsize = 0;
+  ip->dhi = 0;
   iupdate(ip);
 }
 
@@ -461,13 +953,70 @@ stati(struct inode *ip, struct stat *st)
 }
 
 //PAGEBREAK!
-// Read data from inode.
+// Read pages pgno..pgno+n-1 of ip, n <= PCRAPAGES, into the
+// pages data[0..n-1] for the page cache. The block reads are
+// queued in batches before waiting for any, so the disk can
+// merge them; like read-ahead, a batch holds at most a quarter
+// of the buffer cache locked. Bytes past the end of the file
+// are left alone.
 // Caller must hold ip->lock.
-int
-readi(struct inode *ip, char *dst, uint off, uint n)
+void
+ireadpages(struct inode *ip, uint pgno, int n, char **data)
+{
+  struct buf *bp[PCRAPAGES*(PGSIZE/BSIZE)];
+  uint off, end, nb, batch, i, j, m;
+
+  off = pgno * PGSIZE;
+  end = off + n*PGSIZE;
+  if(end > ip->size)
+    end = ip->size;
+  if(off >= end)
+    return;
+  nb = (end - off + BSIZE-1) / BSIZE;
+  if((batch = bcachesize()/4) == 0)
+    batch = 1;
+  for(j = 0; j < nb; j += batch){
+    for(i = j; i < nb && i < j + batch; i++)
+      bp[i] = bread_async(ip->dev, bmap(ip, off/BSIZE + i));
+    for(i = j; i < nb && i < j + batch; i++){
+      bread_wait(bp[i]);
+      m = min(BSIZE, end - (off + i*BSIZE));
+      memmove(data[i/(PGSIZE/BSIZE)] + i%(PGSIZE/BSIZE)*BSIZE, bp[i]->data, m);
+      brelse(bp[i]);
+    }
+  }
+}
+
+// Start reading the blocks of [off, off+n) of ip from the disk,
+// without waiting, unless their pages are cached already; for
+// reading ahead of a sequential reader.
+// Caller must hold ip->lock.
+void
+ireadahead(struct inode *ip, uint off, uint n)
+{
+  uint bn, end;
+
+  if(ip->type != T_FILE)
+    return;
+  end = off + n;
+  if(end > ip->size || end < off)
+    end = ip->size;
+  for(bn = off/BSIZE; bn*BSIZE < end; bn++)
+    if(!pcached(ip, bn*BSIZE/PGSIZE))
+      breadahead(ip->dev, bmap(ip, bn));
+}
+
+// Read data from inode into dst, which is a user address of
+// the current process if user is set. File data comes from
+// the page cache; directories and devices are read directly.
+// Caller must hold ip->lock.
+static int
+iread(struct inode *ip, int user, char *dst, uint off, uint n)
 {
   uint tot, m;
   struct buf *bp;
+  char *data;
+  int r;
 
   if(ip->type == T_DEV){
     if(ip->major < 0 || ip->major >= NDEV || !devsw[ip->major].read)
@@ -481,23 +1030,229 @@ readi(struct inode *ip, char *dst, uint off, uint n)
   if(off + n > ip->size)
     n = ip->size - off;
 
+  if(ip->type == T_FILE){
+    for(tot=0; tot<n; tot+=m, off+=m, dst+=m){
+      if((data = pget(ip, off/PGSIZE)) == 0)
+        return -1;
+      m = min(n - tot, PGSIZE - off%PGSIZE);
+      r = 0;
+      if(!user)
+        memmove(dst, data + off%PGSIZE, m);
+      else
+        r = ucopyout(dst, data + off%PGSIZE, m);
+      pput(ip, off/PGSIZE);
+      if(r < 0)
+        return -1;
+    }
+    return n;
+  }
+
   for(tot=0; tot<n; tot+=m, off+=m, dst+=m){
     bp = bread(ip->dev, bmap(ip, off/BSIZE));
     m = min(n - tot, BSIZE - off%BSIZE);
-    memmove(dst, bp->data + off%BSIZE, m);
+    if(!user)
+      memmove(dst, bp->data + off%BSIZE, m);
+    else if(ucopyout(dst, bp->data + off%BSIZE, m) < 0){
+      brelse(bp);
+      return -1;
+    }
     brelse(bp);
   }
   return n;
 }
 
-// PAGEBREAK!
-// Write data to inode.
-// Caller must hold ip->lock.
 int
-writei(struct inode *ip, char *src, uint off, uint n)
+readi(struct inode *ip, char *dst, uint off, uint n)
 {
-  uint tot, m;
+  return iread(ip, 0, dst, off, n);
+}
+
+// Read into user memory, which may fault.
+int
+ureadi(struct inode *ip, char *dst, uint off, uint n)
+{
+  return iread(ip, 1, dst, off, n);
+}
+
+//PAGEBREAK!
+// Delayed allocation. Writes to a file only fill pages of the
+// page cache and mark them dirty, without a transaction; the
+// file's size grows in memory only. iflush() later allocates
+// blocks for the dirty pages, in file order, so a file written
+// a little at a time still gets a contiguous run of blocks, and
+// logs them a few blocks per transaction. It is called by the
+// flusher thread, FLUSHDELAY ticks after the file is written,
+// by fsync(), and by writers when dirty pages fill the cache.
+//
+// A file on the flush queue has a reference, so neither it nor
+// its in-memory size is dropped from the inode cache. Dirty
+// pages are never evicted, so a page that is not cached has
+// all its blocks up to ip->size on disk already; ireadpages()
+// and ireadahead() rely on that.
+
+struct {
+  struct sleeplock lock;   // one flush at a time
+  struct spinlock qlock;
+  struct inode *head;      // files with dirty pages
+  struct inode *tail;
+  int n;
+} flushq;
+
+static void flusher(void);
+
+// Start the flusher thread.
+static void
+flushinit(void)
+{
+  initsleeplock(&flushq.lock, "flush");
+  initlock(&flushq.qlock, "flushq");
+  kproc("flush", flusher);
+}
+
+// Page pgno of ip was written: mark it dirty and queue ip.
+// Caller must hold ip->lock.
+static void
+idirty(struct inode *ip, uint pgno)
+{
+  pdirty(ip, pgno);
+  if(ip->dhi == 0){
+    ip->dlo = pgno;
+    ip->dhi = pgno + 1;
+  } else if(pgno < ip->dlo)
+    ip->dlo = pgno;
+  else if(pgno >= ip->dhi)
+    ip->dhi = pgno + 1;
+
+  acquire(&flushq.qlock);
+  if(!ip->dirty){
+    ip->dirty = 1;
+    ip->dnext = 0;
+    if(flushq.tail)
+      flushq.tail->dnext = ip;
+    else
+      flushq.head = ip;
+    flushq.tail = ip;
+    flushq.n++;
+    release(&flushq.qlock);
+    idup(ip);
+    return;
+  }
+  release(&flushq.qlock);
+}
+
+// Write back the dirty pages of ip: allocate their blocks and
+// log them, FLUSHBLOCKS at a time, then let the on-disk size
+// cover them. The caller must not hold ip->lock or be in a
+// transaction.
+void
+iflush(struct inode *ip)
+{
+  struct buf *bp;
+  char *data;
+  uint pgno, hi, b, n, end;
+
+  acquiresleep(&flushq.lock);
+  ilock(ip);
+  pgno = ip->dlo;
+  hi = ip->dhi;
+  ip->dhi = 0;
+  // An unlinked file's data is freed on its last iput().
+  if(ip->type != T_FILE || ip->nlink == 0)
+    hi = 0;
+  iunlock(ip);
+
+  for(; pgno < hi; pgno++){
+    data = 0;
+    b = 0;
+    do {
+      begin_op();
+      ilock(ip);
+      if(data == 0 && (data = pclean(ip, pgno)) == 0)
+        b = PGSIZE/BSIZE;
+      for(n = 0; n < FLUSHBLOCKS && b < PGSIZE/BSIZE &&
+          pgno*PGSIZE + b*BSIZE < ip->size; n++, b++){
+        bp = bread(ip->dev, bmap(ip, pgno*(PGSIZE/BSIZE) + b));
+        memmove(bp->data, data + b*BSIZE, BSIZE);
+        log_write(bp);
+        brelse(bp);
+      }
+      if(n > 0){
+        end = min(ip->size, pgno*PGSIZE + b*BSIZE);
+        if(end > ip->dsize)
+          ip->dsize = end;
+        iupdate(ip);
+      }
+      if(pgno*PGSIZE + b*BSIZE >= ip->size)
+        b = PGSIZE/BSIZE;
+      iunlock(ip);
+      end_op();
+    } while(b < PGSIZE/BSIZE);
+    if(data)
+      pput(ip, pgno);
+  }
+  releasesleep(&flushq.lock);
+}
+
+// Flush the files that were on the queue when it started.
+// Files written again meanwhile are queued again.
+static void
+flushall(void)
+{
+  struct inode *ip;
+  int n;
+
+  acquire(&flushq.qlock);
+  n = flushq.n;
+  release(&flushq.qlock);
+  while(n-- > 0){
+    acquire(&flushq.qlock);
+    if((ip = flushq.head) == 0){
+      release(&flushq.qlock);
+      break;
+    }
+    if((flushq.head = ip->dnext) == 0)
+      flushq.tail = 0;
+    flushq.n--;
+    ip->dirty = 0;
+    release(&flushq.qlock);
+
+    iflush(ip);
+    begin_op();
+    iput(ip);
+    end_op();
+  }
+}
+
+// The flusher thread. Every FLUSHDELAY ticks, writes back the
+// files written since it last ran.
+static void
+flusher(void)
+{
+  uint ticks0;
+
+  for(;;){
+    acquire(&tickslock);
+    ticks0 = ticks;
+    while(ticks - ticks0 < FLUSHDELAY)
+      sleep(&ticks, &tickslock);
+    release(&tickslock);
+    flushall();
+  }
+}
+
+//PAGEBREAK!
+// Write data to inode from src, which is a user address of
+// the current process if user is set. File data goes to the
+// page cache, to be written back later; directories are
+// written through the log, in the caller's transaction.
+// Caller must hold ip->lock.
+static int
+iwrite(struct inode *ip, int user, char *src, uint off, uint n)
+{
+  uint tot, m, pgno;
+  int r = n;
   struct buf *bp;
+  char *data;
 
   if(ip->type == T_DEV){
     if(ip->major < 0 || ip->major >= NDEV || !devsw[ip->major].write)
@@ -510,19 +1265,60 @@ writei(struct inode *ip, char *src, uint off, uint n)
   if(off + n > MAXFILE*BSIZE)
     return -1;
 
+  if(ip->type == T_FILE){
+    for(tot=0; tot<n; tot+=m, off+=m, src+=m){
+      pgno = off/PGSIZE;
+      if((data = pget(ip, pgno)) == 0){
+        r = -1;
+        break;
+      }
+      m = min(n - tot, PGSIZE - off%PGSIZE);
+      if(!user)
+        memmove(data + off%PGSIZE, src, m);
+      else if(ucopyin(data + off%PGSIZE, src, m) < 0)
+        r = -1;
+      idirty(ip, pgno);
+      pput(ip, pgno);
+      if(r < 0)
+        break;
+    }
+    if(off > ip->size)
+      ip->size = off;
+    return r;
+  }
+
   for(tot=0; tot<n; tot+=m, off+=m, src+=m){
     bp = bread(ip->dev, bmap(ip, off/BSIZE));
     m = min(n - tot, BSIZE - off%BSIZE);
-    memmove(bp->data + off%BSIZE, src, m);
+    if(!user)
+      memmove(bp->data + off%BSIZE, src, m);
+    else if(ucopyin(bp->data + off%BSIZE, src, m) < 0){
+      brelse(bp);
+      r = -1;
+      break;
+    }
     log_write(bp);
     brelse(bp);
   }
 
-  if(n > 0 && off > ip->size){
+  if(tot > 0 && off > ip->size){
     ip->size = off;
     iupdate(ip);
   }
-  return n;
+  return r;
+}
+
+int
+writei(struct inode *ip, char *src, uint off, uint n)
+{
+  return iwrite(ip, 0, src, off, n);
+}
+
+// Write from user memory, which may fault.
+int
+uwritei(struct inode *ip, char *src, uint off, uint n)
+{
+  return iwrite(ip, 1, src, off, n);
 }
 
 //PAGEBREAK!
@@ -534,18 +1330,293 @@ namecmp(const char *s, const char *t)
   return strncmp(s, t, DIRSIZ);
 }
 
+// Hash of a directory entry name.
+static uint
+namehash(char *name)
+{
+  uint h;
+  int i;
+
+  h = 2166136261;
+  for(i = 0; i < DIRSIZ && name[i]; i++)
+    h = (h ^ (uchar)name[i]) * 16777619;
+  return h;
+}
+
+// Hash bucket of a directory entry name.
+static uint
+dirhash(char *name)
+{
+  return namehash(name) % NDIRBUCKET;
+}
+
+// Name cache.
+//
+// The dcache remembers the results of recent directory lookups
+// so that looking up the same path again does not search the
+// directory. An entry maps (dev, directory inum, name) to the
+// inum and offset of the dirent, or to inum 0 if the directory
+// has no such name (a negative entry). Entries only change with
+// the directory locked: dirlookup adds them, dirlink and
+// dirunlink update them, and freeing a directory drops its
+// entries. Entries for unused slots have dinum 0.
+
+struct dentry {
+  uint dev;
+  uint dinum;           // Directory inum, 0 if unused
+  char name[DIRSIZ];
+  uint inum;            // Inum of name in the directory, 0 if none
+  uint off;             // Offset of its dirent
+  struct dentry *hnext; // hash chain
+  struct dentry *prev;  // LRU list
+  struct dentry *next;
+};
+
+struct {
+  struct spinlock lock;
+  struct dentry dentry[NDENTRY];
+  struct dentry *hash[NDHASH];
+  // Linked list of all entries, through prev/next.
+  // head.next is most recently used.
+  struct dentry head;
+  uint lookups;
+  uint hits;
+  uint negative;
+} dcache;
+
+#define DHASH(dev, dinum, name) (((dev)*31 + (dinum)*17 + namehash(name)) % NDHASH)
+
+static void
+dcinit(void)
+{
+  struct dentry *d;
+
+  initlock(&dcache.lock, "dcache");
+  dcache.head.prev = &dcache.head;
+  dcache.head.next = &dcache.head;
+  for(d = dcache.dentry; d < dcache.dentry+NDENTRY; d++){
+    d->next = dcache.head.next;
+    d->prev = &dcache.head;
+    dcache.head.next->prev = d;
+    dcache.head.next = d;
+  }
+}
+
+// Find the entry for name in directory dp and make it the most
+// recently used. Caller must hold dcache.lock.
+static struct dentry*
+dcfind(struct inode *dp, char *name)
+{
+  struct dentry *d;
+
+  for(d = dcache.hash[DHASH(dp->dev, dp->inum, name)]; d; d = d->hnext){
+    if(d->dev == dp->dev && d->dinum == dp->inum && namecmp(name, d->name) == 0){
+      d->next->prev = d->prev;
+      d->prev->next = d->next;
+      d->next = dcache.head.next;
+      d->prev = &dcache.head;
+      dcache.head.next->prev = d;
+      dcache.head.next = d;
+      return d;
+    }
+  }
+  return 0;
+}
+
+// Remove d from its hash chain. Caller must hold dcache.lock.
+static void
+dcunhash(struct dentry *d)
+{
+  struct dentry **pp;
+
+  for(pp = &dcache.hash[DHASH(d->dev, d->dinum, d->name)]; *pp; pp = &(*pp)->hnext){
+    if(*pp == d){
+      *pp = d->hnext;
+      break;
+    }
+  }
+  d->dinum = 0;
+}
+
+// Look name up in the cache for directory dp. Return 1 and set
+// *inum and *off if there is an entry (*inum is 0 for a
+// negative one), or return 0.
+static int
+dcget(struct inode *dp, char *name, uint *inum, uint *off)
+{
+  struct dentry *d;
+
+  acquire(&dcache.lock);
+  dcache.lookups++;
+  if((d = dcfind(dp, name)) != 0){
+    dcache.hits++;
+    if(d->inum == 0)
+      dcache.negative++;
+    *inum = d->inum;
+    *off = d->off;
+  }
+  release(&dcache.lock);
+  return d != 0;
+}
+
+// Record that name in directory dp is inum, with its dirent at
+// off, or that there is no such name if inum is 0.
+static void
+dcput(struct inode *dp, char *name, uint inum, uint off)
+{
+  struct dentry *d;
+  uint h;
+
+  acquire(&dcache.lock);
+  if((d = dcfind(dp, name)) == 0){
+    // Recycle the least recently used entry.
+    d = dcache.head.prev;
+    if(d->dinum)
+      dcunhash(d);
+    d->next->prev = d->prev;
+    d->prev->next = d->next;
+    d->next = dcache.head.next;
+    d->prev = &dcache.head;
+    dcache.head.next->prev = d;
+    dcache.head.next = d;
+    d->dev = dp->dev;
+    d->dinum = dp->inum;
+    strncpy(d->name, name, DIRSIZ);
+    h = DHASH(d->dev, d->dinum, d->name);
+    d->hnext = dcache.hash[h];
+    dcache.hash[h] = d;
+  }
+  d->inum = inum;
+  d->off = off;
+  release(&dcache.lock);
+}
+
+// Drop every entry for directory dinum, which is being freed.
+static void
+dcforget(uint dev, uint dinum)
+{
+  struct dentry *d;
+
+  acquire(&dcache.lock);
+  for(d = dcache.dentry; d < dcache.dentry+NDENTRY; d++)
+    if(d->dinum == dinum && d->dev == dev)
+      dcunhash(d);
+  release(&dcache.lock);
+}
+
+int
+get_dcacheinfo_file_string(char* dst)
+{
+  int off = 0;
+
+  acquire(&dcache.lock);
+  char entries_str[] = "Entries: ";
+  off+=add_string_number(dst,off,entries_str,NDENTRY,add_space);
+  char lookups_str[] = "Lookups: ";
+  off+=add_string_number(dst,off,lookups_str,dcache.lookups,add_space);
+  char hits_str[] = "Hits: ";
+  off+=add_string_number(dst,off,hits_str,dcache.hits,add_space);
+  char negative_str[] = "Negative hits: ";
+  off+=add_string_number(dst,off,negative_str,dcache.negative,add_space);
+  char hit_rate_str[] = "Hit rate (%): ";
+  off+=add_string_number(dst,off,hit_rate_str,dcache.lookups ? dcache.hits*100/dcache.lookups : 0,add_space);
+  release(&dcache.lock);
+  return off;
+}
+
+// Search the first n entries of block bn of directory dp for
+// name, or for a free entry if name is 0. Return the entry's
+// index, setting *inum to its inode number, or -1. If next is
+// set, also return the block's chain link in *next.
+static int
+dirscan(struct inode *dp, uint bn, int n, char *name, uint *inum, uint *next)
+{
+  struct buf *bp;
+  struct dirent *de;
+  int i;
+
+  bp = bread(dp->dev, bmap(dp, bn));
+  de = (struct dirent*)bp->data;
+  for(i = 0; i < n; i++){
+    if(name == 0 && de[i].inum == 0)
+      break;
+    if(name && de[i].inum != 0 && namecmp(name, de[i].name) == 0)
+      break;
+  }
+  if(i < n && inum)
+    *inum = de[i].inum;
+  if(next)
+    memmove(next, de[DPB-1].name, sizeof(*next));
+  brelse(bp);
+  return i < n ? i : -1;
+}
+
+// Read the index of directory dp: return the number of blocks
+// to search in full, and in *chain the first block (plus one)
+// of the hash chain for name.
+static uint
+dirindex(struct inode *dp, char *name, uint *chain)
+{
+  struct buf *bp;
+  struct dirindex *di;
+  uint nlinear;
+
+  *chain = 0;
+  if(dp->addrs[DIRINDEX] == 0)
+    return (dp->size + BSIZE - 1) / BSIZE;
+  bp = bread(dp->dev, dp->addrs[DIRINDEX]);
+  di = (struct dirindex*)bp->data;
+  nlinear = di->nlinear;
+  *chain = di->bucket[dirhash(name)];
+  brelse(bp);
+  return nlinear;
+}
+
+// Number of entries in block bn of the unhashed part of dp.
+static int
+dirslots(struct inode *dp, uint bn)
+{
+  return min(DPB, (dp->size - bn*BSIZE) / sizeof(struct dirent));
+}
+
 // Look for a directory entry in a directory.
 // If found, set *poff to byte offset of entry.
 struct inode*
 dirlookup(struct inode *dp, char *name, uint *poff)
 {
-  uint off, inum;
+  uint off, inum, bn, nlinear, chain;
+  int i;
   struct dirent de;
   struct inode *ip;
 
   if(dp->type != T_DIR && !IS_DEV_DIR(dp))
     panic("dirlookup not DIR");
 
+  if(dp->type == T_DIR){
+    if(dcget(dp, name, &inum, &off))
+      goto cached;
+    nlinear = dirindex(dp, name, &chain);
+    for(bn = 0; bn < nlinear; bn++)
+      if((i = dirscan(dp, bn, dirslots(dp, bn), name, &inum, 0)) >= 0)
+        goto found;
+    for(; chain != 0; chain = off){
+      bn = chain - 1;
+      if((i = dirscan(dp, bn, DPB-1, name, &inum, &off)) >= 0)
+        goto found;
+    }
+    dcput(dp, name, 0, 0);
+    return 0;
+found:
+    off = bn*BSIZE + i*sizeof(de);
+    dcput(dp, name, inum, off);
+cached:
+    if(inum == 0)
+      return 0;
+    if(poff)
+      *poff = off;
+    return iget(dp->dev, inum);
+  }
+
   for(off = 0; off < dp->size || dp->type == T_DEV ; off += sizeof(de)){
     // cprintf("dirlookup: try to read from dir inum: %d n:%d\n",dp->inum, sizeof(de));
     if(readi(dp, (char*)&de, off, sizeof(de)) != sizeof(de)) {
@@ -572,13 +1643,58 @@ dirlookup(struct inode *dp, char *name, uint *poff)
   return 0;
 }
 
+// Set the chain link of block bn of directory dp, or, if bn
+// is 0, the start of the chain in bucket h of the index.
+static void
+dirchain(struct inode *dp, uint bn, uint h, uint link)
+{
+  struct buf *bp;
+
+  if(bn == 0){
+    bp = bread(dp->dev, dp->addrs[DIRINDEX]);
+    ((struct dirindex*)bp->data)->bucket[h] = link;
+  } else {
+    bp = bread(dp->dev, bmap(dp, bn - 1));
+    memmove(((struct dirent*)bp->data)[DPB-1].name, &link, sizeof(link));
+  }
+  log_write(bp);
+  brelse(bp);
+}
+
+// Return the offset of a free entry for name in the hashed part
+// of directory dp, adding a block to name's chain if it is full.
+static uint
+dirhslot(struct inode *dp, char *name)
+{
+  uint bn, chain, prev, next;
+  int i;
+
+  dirindex(dp, name, &chain);
+  for(prev = 0; chain != 0; prev = chain, chain = next)
+    if((i = dirscan(dp, chain - 1, DPB-1, 0, 0, &next)) >= 0)
+      return (chain - 1)*BSIZE + i*sizeof(struct dirent);
+
+  // Every block in the chain is full. Append an empty block
+  // (balloc zeroes it, so its link ends the chain) and link it.
+  bn = dp->size / BSIZE;
+  bmap(dp, bn);
+  dp->size = (bn + 1) * BSIZE;
+  iupdate(dp);
+  dirchain(dp, prev, dirhash(name), bn + 1);
+  return bn*BSIZE;
+}
+
 // Write a new directory entry (name, inum) into the directory dp.
+// A full directory grows by one entry until it has NDIRLINEAR
+// blocks, and then gets an index and grows by hash chains.
 int
 dirlink(struct inode *dp, char *name, uint inum)
 {
-  int off;
+  uint off, bn, nlinear, chain;
+  int i;
   struct dirent de;
   struct inode *ip;
+  struct buf *bp;
 
   // Check that name is not present.
   if((ip = dirlookup(dp, name, 0)) != 0){
@@ -587,21 +1703,51 @@ dirlink(struct inode *dp, char *name, uint inum)
   }
 
   // Look for an empty dirent.
-  for(off = 0; off < dp->size; off += sizeof(de)){
-    if(readi(dp, (char*)&de, off, sizeof(de)) != sizeof(de))
-      panic("dirlink read");
-    if(de.inum == 0)
+  nlinear = dirindex(dp, name, &chain);
+  off = dp->size;
+  for(bn = 0; bn < nlinear; bn++){
+    if((i = dirscan(dp, bn, dirslots(dp, bn), 0, 0, 0)) >= 0){
+      off = bn*BSIZE + i*sizeof(de);
       break;
+    }
+  }
+
+  if(bn == nlinear && dp->type == T_DIR && dp->addrs[DIRINDEX] == 0 &&
+     dp->size >= NDIRLINEAR*BSIZE && dp->size % BSIZE == 0){
+    // Too big to search in full: start hashing.
+    dp->addrs[DIRINDEX] = balloc(dp->dev, igoal(dp));
+    bp = bread(dp->dev, dp->addrs[DIRINDEX]);
+    ((struct dirindex*)bp->data)->nlinear = dp->size / BSIZE;
+    log_write(bp);
+    brelse(bp);
+    iupdate(dp);
   }
+  if(bn == nlinear && dp->addrs[DIRINDEX] != 0)
+    off = dirhslot(dp, name);
 
   strncpy(de.name, name, DIRSIZ);
   de.inum = inum;
   if(writei(dp, (char*)&de, off, sizeof(de)) != sizeof(de))
     panic("dirlink");
+  if(dp->type == T_DIR)
+    dcput(dp, name, inum, off);
 
   return 0;
 }
 
+// Remove the entry for name, at offset off, from directory dp.
+void
+dirunlink(struct inode *dp, char *name, uint off)
+{
+  struct dirent de;
+
+  memset(&de, 0, sizeof(de));
+  if(writei(dp, (char*)&de, off, sizeof(de)) != sizeof(de))
+    panic("unlink: writei");
+  if(dp->type == T_DIR)
+    dcput(dp, name, 0, 0);
+}
+
 //PAGEBREAK!
 // Paths
 
@@ -6,8 +6,13 @@
 #define BSIZE 512  // block size
 
 // Disk layout:
-// [ boot block | super block | log | inode blocks |
-//                                          free bit map | data blocks]
+// [ boot block | super block | log | group 0 | group 1 | ... ]
+//
+// and each block group is laid out as
+// [ free bit map block | inode blocks | data blocks ]
+//
+// so that a file's inode, its data and its directory can all sit
+// in one region of the disk.
 //
 // mkfs computes the super block and builds an initial file system. The
 // super block describes the disk layout:
@@ -19,11 +24,16 @@ struct superblock {
   uint logstart;     // Block number of first log block
   uint inodestart;   // Block number of first inode block
   uint bmapstart;    // Block number of first free map block
+  uint ngroups;      // Number of block groups
+  uint groupstart;   // Block number of the first group
+  uint bpg;          // Blocks per group
+  uint ipg;          // Inodes per group
 };
 
-#define NDIRECT 12
+#define NDIRECT 10
 #define NINDIRECT (BSIZE / sizeof(uint))
-#define MAXFILE (NDIRECT + NINDIRECT)
+#define NDINDIRECT (NINDIRECT * NINDIRECT)
+#define MAXFILE (NDIRECT + NINDIRECT + NDINDIRECT)
 
 // On-disk inode structure
 struct dinode {
@@ -32,20 +42,31 @@ struct dinode {
   short minor;          // Minor device number (T_DEV only)
   short nlink;          // Number of links to inode in file system
   uint size;            // Size of file (bytes)
-  uint addrs[NDIRECT+1];   // Data block addresses
+  uint addrs[NDIRECT+3];   // Data block addresses, then DIRINDEX
 };
 
 // Inodes per block.
 #define IPB           (BSIZE / sizeof(struct dinode))
 
-// Block containing inode i
-#define IBLOCK(i, sb)     ((i) / IPB + sb.inodestart)
-
 // Bitmap bits per block
 #define BPB           (BSIZE*8)
 
+// Group holding block b, and the first block of group g
+#define BGROUP(b, sb)     (((b) - sb.groupstart) / sb.bpg)
+#define GSTART(g, sb)     (sb.groupstart + (g) * sb.bpg)
+
+// Group holding inode i, and its first data block
+#define IGROUP(i, sb)     ((i) / sb.ipg)
+#define GDATA(g, sb)      (GSTART(g, sb) + 1 + sb.ipg / IPB)
+
+// Block containing inode i
+#define IBLOCK(i, sb)     (GSTART(IGROUP(i, sb), sb) + 1 + ((i) % sb.ipg) / IPB)
+
 // Block of free map containing bit for block b
-#define BBLOCK(b, sb) (b/BPB + sb.bmapstart)
+#define BBLOCK(b, sb)     GSTART(BGROUP(b, sb), sb)
+
+// Bit for block b within its group's free map block
+#define BBIT(b, sb)       (((b) - sb.groupstart) % sb.bpg)
 
 // Directory is a file containing a sequence of dirent structures.
 #define DIRSIZ 14
@@ -55,3 +76,23 @@ struct dirent {
   char name[DIRSIZ];
 };
 
+// Directory entries per block
+#define DPB           (BSIZE / sizeof(struct dirent))
+
+// A directory that outgrows NDIRLINEAR blocks gets an index
+// block, addrs[DIRINDEX]. Its first nlinear blocks are searched
+// in full as before; each block after them belongs to the hash
+// chain of one bucket and holds only names that hash there. The
+// last dirent of a chained block is a link, not an entry: its
+// inum is 0, so programs reading the directory skip it, and its
+// name holds the file block number plus one of the next block
+// in the chain (0 ends the chain).
+#define NDIRLINEAR    8
+#define NDIRBUCKET    (BSIZE / sizeof(uint) - 1)
+#define DIRINDEX      (NDIRECT+2)
+
+struct dirindex {
+  uint nlinear;              // Blocks before the hashed part
+  uint bucket[NDIRBUCKET];   // First block of each chain, plus one
+};
+
@@ -3,15 +3,46 @@
 #include "types.h"
 #include "stat.h"
 #include "user.h"
+#include "fcntl.h"
 
 char buf[1024];
 int match(char*, char*);
 
+// Text ends at the end of its line.
+#define EOL(c) ((c) == '\0' || (c) == '\n')
+
+// Grep the n bytes of a file mapped at map, writing matching
+// lines straight from the mapping instead of copying them.
+// Like the read() loop, ignores a last line with no newline.
+void
+grepmap(char *pattern, char *map, int n)
+{
+  char *p, *q, *end;
+
+  end = map + n;
+  for(p = map; p < end; p = q+1){
+    for(q = p; q < end && *q != '\n'; q++)
+      ;
+    if(q == end)
+      break;
+    if(match(pattern, p))
+      write(1, p, q+1 - p);
+  }
+}
+
 void
 grep(char *pattern, int fd)
 {
   int n, m;
   char *p, *q;
+  struct stat st;
+
+  if(fstat(fd, &st) == 0 && st.type == T_FILE && st.size > 0 &&
+     (p = mmap(0, st.size, PROT_READ, MAP_SHARED, fd, 0)) != (char*)-1){
+    grepmap(pattern, p, st.size);
+    munmap(p, st.size);
+    return;
+  }
 
   m = 0;
   while((n = read(fd, buf+m, sizeof(buf)-m-1)) > 0){
@@ -77,7 +108,7 @@ match(char *re, char *text)
   do{  // must look at empty string
     if(matchhere(re, text))
       return 1;
-  }while(*text++ != '\0');
+  }while(!EOL(*text++));
   return 0;
 }
 
@@ -89,8 +120,8 @@ int matchhere(char *re, char *text)
   if(re[1] == '*')
     return matchstar(re[0], re+2, text);
   if(re[0] == '$' && re[1] == '\0')
-    return *text == '\0';
-  if(*text!='\0' && (re[0]=='.' || re[0]==*text))
+    return EOL(*text);
+  if(!EOL(*text) && (re[0]=='.' || re[0]==*text))
     return matchhere(re+1, text+1);
   return 0;
 }
@@ -101,7 +132,7 @@ int matchstar(int c, char *re, char *text)
   do{  // a * matches zero or more instances
     if(matchhere(re, text))
       return 1;
-  }while(*text!='\0' && (*text++==c || c=='.'));
+  }while(!EOL(*text) && (*text++==c || c=='.'));
   return 0;
 }
 
@@ -1,4 +1,5 @@
-// Simple PIO-based (non-DMA) IDE driver code.
+// Simple IDE driver code.  Transfers use PCI bus-master DMA when
+// the controller offers it, and PIO otherwise.
 
 #include "types.h"
 #include "defs.h"
@@ -23,16 +24,80 @@
 #define IDE_CMD_WRITE 0x30
 #define IDE_CMD_RDMUL 0xc4
 #define IDE_CMD_WRMUL 0xc5
-
-// idequeue points to the buf now being read/written to the disk.
-// idequeue->qnext points to the next buf to be processed.
+#define IDE_CMD_READ_DMA  0xc8
+#define IDE_CMD_WRITE_DMA 0xca
+
+// Bus-master IDE registers, relative to idebmr.
+#define BM_CMD        0
+#define BM_STATUS     2
+#define BM_PRDT       4
+#define BM_START      0x01
+#define BM_READ       0x08  // device to memory
+#define BM_ERR        0x02
+#define BM_INTR       0x04
+
+#define PCI_CONFIG_ADDR 0xcf8
+#define PCI_CONFIG_DATA 0xcfc
+
+#define IDE_MAXMERGE  64  // most blocks moved by one transfer
+#define IDE_DEADLINE  5   // ticks a request may wait before it goes first
+
+// idequeue holds the bufs waiting for the disk, oldest first,
+// linked through qnext.  idecur is the buf whose sector the
+// disk is transferring now; the rest of the same transfer
+// follows it on idecur->qnext.
 // You must hold idelock while manipulating queue.
 
 static struct spinlock idelock;
 static struct buf *idequeue;
+static struct buf *idecur;
+static uint idepos;  // block after the last one dispatched
+
+static struct {
+  uint depth;      // bufs queued or being transferred
+  uint maxdepth;
+  uint requests;   // bufs completed
+  uint transfers;  // commands issued to the disk
+  uint merges;     // bufs that joined another buf's transfer
+  uint deadlines;  // transfers started by IDE_DEADLINE
+  uint service;    // total queued-to-done time, in 1024 cycles
+} idestat;
 
 static int havedisk1;
-static void idestart(struct buf*);
+static void idestart(struct buf*, int);
+
+// Physical region descriptor: one piece of memory for a DMA transfer.
+struct prd {
+  uint addr;
+  ushort count;
+  ushort flags;
+};
+#define PRD_EOT 0x8000  // last descriptor of the table
+
+// The table must not cross a 64KB boundary.
+static struct prd prdt[IDE_MAXMERGE] __attribute__((aligned(512)));
+static ushort idebmr;  // bus-master I/O base, 0 when using PIO
+
+int
+add_queue_stats(char* dst, int off){
+  char mode_str[] = "Transfer mode: ";
+  off+=add_string_number(dst,off,mode_str,-1,no_space);
+  off+=add_string_number(dst,off,idebmr ? "DMA" : "PIO",-1,add_space);
+  char depth_str[] = "Queue depth: ";
+  off+=add_string_number(dst,off,depth_str,idestat.depth,add_space);
+  char maxdepth_str[] = "Max queue depth: ";
+  off+=add_string_number(dst,off,maxdepth_str,idestat.maxdepth,add_space);
+  char transfers_str[] = "Transfers: ";
+  off+=add_string_number(dst,off,transfers_str,idestat.transfers,add_space);
+  char merges_str[] = "Merged requests: ";
+  off+=add_string_number(dst,off,merges_str,idestat.merges,add_space);
+  char deadlines_str[] = "Deadline dispatches: ";
+  off+=add_string_number(dst,off,deadlines_str,idestat.deadlines,add_space);
+  char service_str[] = "Average service time (kcycles): ";
+  off+=add_string_number(dst,off,service_str,
+                         idestat.requests ? idestat.service/idestat.requests : 0,add_space);
+  return off;
+}
 
 int
 create_empty_queue_string(char* dst){
@@ -45,6 +110,7 @@ create_empty_queue_string(char* dst){
   off+=add_string_number(dst,off,write_waiting_operations_str,0,add_space);
   char working_blocks_str[] = "Working blocks: "; 
   off+=add_string_number(dst,off,working_blocks_str,-1,add_space);
+  off = add_queue_stats(dst,off);
   return off; 
 }
 
@@ -52,6 +118,8 @@ create_empty_queue_string(char* dst){
 int
 get_ideinfo_file_string(char* dst){
   struct buf *b;
+  struct buf *lists[2];
+  int i;
   int off = 0;
   int waiting_operations = 0;
   int read_waiting_operations = 0;
@@ -59,21 +127,26 @@ get_ideinfo_file_string(char* dst){
 
   acquire(&idelock);
 
-  if((b = idequeue) == 0){
+  if(idecur == 0 && idequeue == 0){
+    off = create_empty_queue_string(dst);
     release(&idelock);
-    return create_empty_queue_string(dst);
+    return off;
   }
-  while(b!=0){
-  // If B_DIRTY is set, write_waiting_operations
-  // Else if B_VALID is not set, read_waiting_operations.
-    if((b->flags & B_VALID) == 0){
-      read_waiting_operations+=1;
+  // the transfer in progress, then the waiting requests
+  lists[0] = idecur;
+  lists[1] = idequeue;
+  for(i = 0; i < 2; i++){
+    for(b = lists[i]; b != 0; b = b->qnext){
+    // If B_DIRTY is set, write_waiting_operations
+    // Else if B_VALID is not set, read_waiting_operations.
+      if((b->flags & B_VALID) == 0){
+        read_waiting_operations+=1;
+      }
+      else if(b->flags & B_DIRTY){
+        write_waiting_operations+=1;
+      }    
+      waiting_operations+=1;
     }
-    else if((b->flags & B_DIRTY) == 0){
-      write_waiting_operations+=1;
-    }    
-    waiting_operations+=1;
-    b = b->qnext;
   }
   char waiting_operations_str[] = "Waiting operations: ";
   off+=add_string_number(dst,off,waiting_operations_str,waiting_operations,add_space);
@@ -84,23 +157,24 @@ get_ideinfo_file_string(char* dst){
   char working_blocks_str[] = "Working blocks: "; 
   off+=add_string_number(dst,off,working_blocks_str,-1,add_space);
   // now for Working blocks list  
-  b = idequeue;
-  while(b!=0){
-    // (#device,#block) ;
-    char left[] = "("; 
-    off+=add_string_number(dst,off,left,b->dev,no_space);
-    char comma[] = ","; 
-    off+=add_string_number(dst,off,comma,b->blockno,no_space);
-    char right[] = ")"; 
-    off+=add_string_number(dst,off,right,-1,no_space);
-
-    if(b->qnext!=0){
-      char sep[] = ";"; 
-      off+=add_string_number(dst,off,sep,-1,no_space);
+  for(i = 0; i < 2; i++){
+    for(b = lists[i]; b != 0; b = b->qnext){
+      // (#device,#block) ;
+      char left[] = "("; 
+      off+=add_string_number(dst,off,left,b->dev,no_space);
+      char comma[] = ","; 
+      off+=add_string_number(dst,off,comma,b->blockno,no_space);
+      char right[] = ")"; 
+      off+=add_string_number(dst,off,right,-1,no_space);
+
+      if(b->qnext!=0 || (i == 0 && idequeue != 0)){
+        char sep[] = ";"; 
+        off+=add_string_number(dst,off,sep,-1,no_space);
+      }
     }
-    b = b->qnext;
   }
   off+=add_string_number(dst,off,"",-1,add_space);
+  off = add_queue_stats(dst,off);
   release(&idelock);
   return off;
 }
@@ -117,6 +191,44 @@ idewait(int checkerr)
   return 0;
 }
 
+static uint
+pciread(int dev, int func, int reg)
+{
+  outl(PCI_CONFIG_ADDR, 0x80000000 | (dev<<11) | (func<<8) | reg);
+  return inl(PCI_CONFIG_DATA);
+}
+
+static void
+pciwrite(int dev, int func, int reg, uint val)
+{
+  outl(PCI_CONFIG_ADDR, 0x80000000 | (dev<<11) | (func<<8) | reg);
+  outl(PCI_CONFIG_DATA, val);
+}
+
+// Look on PCI bus 0 for an IDE controller that can bus-master,
+// turn bus mastering on and return its register base, or 0.
+static ushort
+idefindbm(void)
+{
+  int dev, func;
+  uint bar;
+
+  for(dev = 0; dev < 32; dev++){
+    for(func = 0; func < 8; func++){
+      if((pciread(dev, func, 0x00) & 0xffff) == 0xffff)
+        continue;
+      if((pciread(dev, func, 0x08) >> 16) != 0x0101)  // mass storage, IDE
+        continue;
+      bar = pciread(dev, func, 0x20);  // BAR4: bus-master registers
+      if((bar & 1) == 0 || (bar & ~3) == 0)
+        continue;
+      pciwrite(dev, func, 0x04, pciread(dev, func, 0x04) | 0x5); // I/O, master
+      return bar & ~3;
+    }
+  }
+  return 0;
+}
+
 void
 ideinit(void)
 {
@@ -137,15 +249,20 @@ ideinit(void)
 
   // Switch back to disk 0.
   outb(0x1f6, 0xe0 | (0<<4));
+
+  if(bootopt("ide=dma") || (IDEDMA && !bootopt("ide=pio")))
+    idebmr = idefindbm();
+  cprintf("ide: %s transfers\n", idebmr ? "bus-master DMA" : "PIO");
 }
 
-// Start the request for b.  Caller must hold idelock.
+// Start the transfer of the n consecutive blocks on the list
+// starting at b.  Caller must hold idelock.
 static void
-idestart(struct buf *b)
+idestart(struct buf *b, int n)
 {
   if(b == 0)
     panic("idestart");
-  if(b->blockno >= FSSIZE)
+  if(b->blockno + n > FSSIZE)
     panic("incorrect blockno");
   int sector_per_block =  BSIZE/SECTOR_SIZE;
   int sector = b->blockno * sector_per_block;
@@ -154,14 +271,31 @@ idestart(struct buf *b)
 
   if (sector_per_block > 7) panic("idestart");
 
+  if(idebmr){
+    // Point the bus master at the data of every buf in the transfer.
+    struct buf *p;
+    int i = 0;
+    for(p = b; p != 0; p = p->qnext, i++){
+      prdt[i].addr = V2P(p->data);
+      prdt[i].count = BSIZE;
+      prdt[i].flags = (p->qnext == 0) ? PRD_EOT : 0;
+    }
+    outl(idebmr+BM_PRDT, V2P(prdt));
+    outb(idebmr+BM_CMD, (b->flags & B_DIRTY) ? 0 : BM_READ);
+    outb(idebmr+BM_STATUS, BM_ERR | BM_INTR);  // clear
+  }
+
   idewait(0);
   outb(0x3f6, 0);  // generate interrupt
-  outb(0x1f2, sector_per_block);  // number of sectors
+  outb(0x1f2, sector_per_block * n);  // number of sectors
   outb(0x1f3, sector & 0xff);
   outb(0x1f4, (sector >> 8) & 0xff);
   outb(0x1f5, (sector >> 16) & 0xff);
   outb(0x1f6, 0xe0 | ((b->dev&1)<<4) | ((sector>>24)&0x0f));
-  if(b->flags & B_DIRTY){
+  if(idebmr){
+    outb(0x1f7, (b->flags & B_DIRTY) ? IDE_CMD_WRITE_DMA : IDE_CMD_READ_DMA);
+    outb(idebmr+BM_CMD, inb(idebmr+BM_CMD) | BM_START);
+  } else if(b->flags & B_DIRTY){
     outb(0x1f7, write_cmd);
     outsl(0x1f0, b->data, BSIZE/4);
   } else {
@@ -169,43 +303,179 @@ idestart(struct buf *b)
   }
 }
 
+static void
+ideunqueue(struct buf *b)
+{
+  struct buf **pp;
+
+  for(pp=&idequeue; *pp != b; pp=&(*pp)->qnext)
+    ;
+  *pp = b->qnext;
+  b->qnext = 0;
+}
+
+// Choose the request to serve next: the oldest one if it has
+// waited IDE_DEADLINE ticks, otherwise the lowest block at or
+// after idepos, wrapping around to the lowest block overall.
+static struct buf*
+idepick(void)
+{
+  struct buf *b, *next, *lowest;
+
+  if(ticks - idequeue->qticks >= IDE_DEADLINE){
+    idestat.deadlines++;
+    return idequeue;
+  }
+  next = lowest = 0;
+  for(b = idequeue; b != 0; b = b->qnext){
+    if(b->blockno >= idepos && (next == 0 || b->blockno < next->blockno))
+      next = b;
+    if(lowest == 0 || b->blockno < lowest->blockno)
+      lowest = b;
+  }
+  return next ? next : lowest;
+}
+
+// If the disk is idle, start a transfer for the next request
+// together with the queued requests for the blocks around it
+// in the same direction.  Caller must hold idelock.
+static void
+idedispatch(void)
+{
+  struct buf *first, *last, *b;
+  int n, maxmerge;
+
+  if(idecur != 0 || idequeue == 0)
+    return;
+
+  // Only single-sector blocks can share a PIO READ/WRITE command.
+  maxmerge = (idebmr || BSIZE == SECTOR_SIZE) ? IDE_MAXMERGE : 1;
+
+  first = last = idepick();
+  ideunqueue(first);
+  n = 1;
+  b = idequeue;
+  while(b != 0 && n < maxmerge){
+    if(b->dev != first->dev || (b->flags & B_DIRTY) != (first->flags & B_DIRTY)){
+      b = b->qnext;
+      continue;
+    }
+    if(b->blockno == last->blockno + 1){
+      ideunqueue(b);
+      last->qnext = b;
+      last = b;
+    } else if(b->blockno + 1 == first->blockno){
+      ideunqueue(b);
+      b->qnext = first;
+      first = b;
+    } else {
+      b = b->qnext;
+      continue;
+    }
+    n++;
+    b = idequeue;  // the list changed; look again
+  }
+
+  idestat.transfers++;
+  idestat.merges += n - 1;
+  idepos = last->blockno + 1;
+  idecur = first;
+  idestart(first, n);
+}
+
+// Mark b done and wake the process waiting for it.
+static void
+idedone(struct buf *b)
+{
+  b->flags |= B_VALID;
+  b->flags &= ~(B_DIRTY|B_READAHEAD);
+  idestat.depth--;
+  idestat.requests++;
+  idestat.service += ((uint)rdtsc() - b->qcycles) >> 10;
+  wakeup(b);
+}
+
+// A DMA transfer finished: the whole list at idecur is done.
+// If the bus master reports an error, drop to PIO for good and
+// redo the transfer that way.
+static void
+idedmaintr(void)
+{
+  struct buf *b, *next;
+  int st, n;
+
+  st = inb(idebmr+BM_STATUS);
+  if((st & BM_INTR) == 0)
+    return;
+  outb(idebmr+BM_CMD, 0);
+  outb(idebmr+BM_STATUS, BM_ERR | BM_INTR);
+  if(idewait(1) < 0 || (st & BM_ERR)){
+    cprintf("ide: DMA error, using PIO\n");
+    idebmr = 0;
+    for(n = 0, b = idecur; b != 0; b = b->qnext)
+      n++;
+    idestart(idecur, n);
+    return;
+  }
+  for(b = idecur; b != 0; b = next){
+    next = b->qnext;
+    idedone(b);
+  }
+  idecur = 0;
+
+  // Start disk on the next request.
+  idedispatch();
+}
+
 // Interrupt handler.
 void
 ideintr(void)
 {
   struct buf *b;
 
-  // First queued buffer is the active request.
   acquire(&idelock);
 
-  if((b = idequeue) == 0){
+  if(idecur == 0){
+    release(&idelock);
+    return;
+  }
+  if(idebmr){
+    idedmaintr();
     release(&idelock);
     return;
   }
-  idequeue = b->qnext;
+
+  // idecur is the sector the disk just finished.
+  b = idecur;
+  idecur = b->qnext;
 
   // Read data if needed.
   if(!(b->flags & B_DIRTY) && idewait(1) >= 0)
     insl(0x1f0, b->data, BSIZE/4);
 
   // Wake process waiting for this buf.
-  b->flags |= B_VALID;
-  b->flags &= ~B_DIRTY;
-  wakeup(b);
+  idedone(b);
 
-  // Start disk on next buf in queue.
-  if(idequeue != 0)
-    idestart(idequeue);
+  if(idecur != 0){
+    // The transfer goes on with the next block; a write
+    // hands the disk its data now.
+    if(idecur->flags & B_DIRTY)
+      outsl(0x1f0, idecur->data, BSIZE/4);
+  } else {
+    // Start disk on the next request.
+    idedispatch();
+  }
 
   release(&idelock);
 }
 
 //PAGEBREAK!
-// Sync buf with disk.
+// Queue b for the disk and return without waiting.
 // If B_DIRTY is set, write buf to disk, clear B_DIRTY, set B_VALID.
 // Else if B_VALID is not set, read buf from disk, set B_VALID.
+// The caller keeps b locked until iderw_wait() returns.
 void
-iderw(struct buf *b)
+iderw_start(struct buf *b)
 {
   struct buf **pp;
 
@@ -220,19 +490,35 @@ iderw(struct buf *b)
 
   // Append b to idequeue.
   b->qnext = 0;
+  b->qticks = ticks;
+  b->qcycles = (uint)rdtsc();
   for(pp=&idequeue; *pp; pp=&(*pp)->qnext)  //DOC:insert-queue
     ;
   *pp = b;
+  if(++idestat.depth > idestat.maxdepth)
+    idestat.maxdepth = idestat.depth;
 
   // Start disk if necessary.
-  if(idequeue == b)
-    idestart(b);
+  idedispatch();
+
+  release(&idelock);
+}
 
-  // Wait for request to finish.
+// Wait for a request queued by iderw_start() to finish.
+void
+iderw_wait(struct buf *b)
+{
+  acquire(&idelock);
   while((b->flags & (B_VALID|B_DIRTY)) != B_VALID){
     sleep(b, &idelock);
   }
-
-
   release(&idelock);
 }
+
+// Sync buf with disk.
+void
+iderw(struct buf *b)
+{
+  iderw_start(b);
+  iderw_wait(b);
+}
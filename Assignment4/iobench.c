@@ -0,0 +1,74 @@
+// Vectored write benchmark: writes a file of NREC small records
+// once with a write() per record, once with a writev() per
+// IOVMAX records and once with pwrite(), and reports the ticks
+// each takes. writev() puts as many records in each log
+// transaction as fit, where write() commits one per record.
+
+#include "param.h"
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+#include "uio.h"
+
+#define NREC 2048
+#define RECSIZE 64
+
+char rec[IOVMAX][RECSIZE];
+
+int
+main(int argc, char *argv[])
+{
+  struct iovec iov[IOVMAX];
+  int fd, i, start, twrite, twritev, tpwrite;
+
+  for(i = 0; i < IOVMAX; i++){
+    memset(rec[i], 'a' + i % 26, RECSIZE);
+    iov[i].iov_base = rec[i];
+    iov[i].iov_len = RECSIZE;
+  }
+
+  fd = open("iobench", O_CREATE | O_RDWR);
+  if(fd < 0){
+    printf(1, "iobench: cannot create iobench\n");
+    exit();
+  }
+  start = uptime();
+  for(i = 0; i < NREC; i++){
+    if(write(fd, rec[i % IOVMAX], RECSIZE) != RECSIZE){
+      printf(1, "iobench: write failed\n");
+      exit();
+    }
+  }
+  twrite = uptime() - start;
+  close(fd);
+  unlink("iobench");
+
+  fd = open("iobench", O_CREATE | O_RDWR);
+  start = uptime();
+  for(i = 0; i < NREC; i += IOVMAX){
+    if(writev(fd, iov, IOVMAX) != IOVMAX * RECSIZE){
+      printf(1, "iobench: writev failed\n");
+      exit();
+    }
+  }
+  twritev = uptime() - start;
+  close(fd);
+
+  // Overwrite the same file in place at explicit offsets.
+  fd = open("iobench", O_RDWR);
+  start = uptime();
+  for(i = 0; i < NREC; i++){
+    if(pwrite(fd, rec[i % IOVMAX], RECSIZE, i * RECSIZE) != RECSIZE){
+      printf(1, "iobench: pwrite failed\n");
+      exit();
+    }
+  }
+  tpwrite = uptime() - start;
+  close(fd);
+  unlink("iobench");
+
+  printf(1, "iobench: %d records of %d bytes: write %d ticks, writev %d ticks, pwrite %d ticks\n",
+         NREC, RECSIZE, twrite, twritev, tpwrite);
+  exit();
+}
@@ -1,6 +1,19 @@
 // Physical memory allocator, intended to allocate
 // memory for user processes, kernel stacks, page table pages,
-// and pipe buffers. Allocates 4096-byte pages.
+// and pipe buffers. Allocates 4096-byte pages, or runs of
+// a power of two contiguous pages.
+//
+// Free memory is kept by a buddy allocator: a block of 2^k
+// pages, aligned to 2^k pages, is on free list k, and when it
+// and its buddy (the other half of the enclosing 2^(k+1)-page
+// block) are both free they are merged. kmem.lock protects the
+// buddy lists.
+//
+// Single pages, by far the most common request, go through a
+// cache on each CPU. A CPU that runs out takes KBATCH pages
+// from the buddy lists at once, and one that has more than
+// KCACHEMAX gives KBATCH back, so most kalloc() and kfree()
+// calls do not touch kmem.lock at all.
 
 #include "types.h"
 #include "defs.h"
@@ -13,14 +26,28 @@ void freerange(void *vstart, void *vend);
 extern char end[]; // first address after kernel loaded from ELF file
                    // defined by the kernel linker script in kernel.ld
 
+#define NPAGE (PHYSTOP / PGSIZE)
+#define PFN(v) (V2P(v) / PGSIZE)
+
 struct run {
   struct run *next;
+  struct run *prev;  // on the buddy lists only
+};
+
+struct cpucache {
+  struct run *free;
+  int n;
 };
 
 struct {
   struct spinlock lock;
   int use_lock;
-  struct run *freelist;
+  struct run area[MAXORDER+1];  // circular free list of each order
+  uchar order[NPAGE];  // 1+order of the free block a page starts
+  int nfree;           // pages on the buddy lists
+  uint refills;
+  uint drains;
+  struct cpucache cpu[NCPU];
 } kmem;
 
 // Initialization happens in two phases.
@@ -31,8 +58,14 @@ struct {
 void
 kinit1(void *vstart, void *vend)
 {
+  int k;
+
   initlock(&kmem.lock, "kmem");
   kmem.use_lock = 0;
+  for(k = 0; k <= MAXORDER; k++){
+    kmem.area[k].next = &kmem.area[k];
+    kmem.area[k].prev = &kmem.area[k];
+  }
   freerange(vstart, vend);
 }
 
@@ -51,6 +84,82 @@ freerange(void *vstart, void *vend)
   for(; p + PGSIZE <= (char*)vend; p += PGSIZE)
     kfree(p);
 }
+
+// Put the block of 2^order pages at v on the buddy lists,
+// merging it with its buddy as long as that is free.
+// Caller holds kmem.lock.
+static void
+buddyfree(char *v, int order)
+{
+  struct run *r;
+  uint pfn, buddy;
+
+  kmem.nfree += 1 << order;
+  pfn = PFN(v);
+  for(; order < MAXORDER; order++){
+    buddy = pfn ^ (1 << order);
+    if(buddy >= NPAGE || kmem.order[buddy] != order + 1)
+      break;
+    r = (struct run*)P2V(buddy * PGSIZE);
+    r->prev->next = r->next;
+    r->next->prev = r->prev;
+    kmem.order[buddy] = 0;
+    pfn &= ~(1 << order);
+  }
+  r = (struct run*)P2V(pfn * PGSIZE);
+  r->next = kmem.area[order].next;
+  r->prev = &kmem.area[order];
+  r->next->prev = r;
+  kmem.area[order].next = r;
+  kmem.order[pfn] = order + 1;
+}
+
+// Take a block of 2^order pages off the buddy lists, splitting
+// a bigger block if there is none that size. Returns 0 if
+// memory is exhausted. Caller holds kmem.lock.
+static char*
+buddyalloc(int order)
+{
+  struct run *r, *half;
+  uint pfn;
+  int k;
+
+  for(k = order; k <= MAXORDER && kmem.area[k].next == &kmem.area[k]; k++)
+    ;
+  if(k > MAXORDER)
+    return 0;
+  r = kmem.area[k].next;
+  r->prev->next = r->next;
+  r->next->prev = r->prev;
+  pfn = PFN(r);
+  kmem.order[pfn] = 0;
+  kmem.nfree -= 1 << k;
+
+  // Give back the upper halves until the block is the right size.
+  while(k > order){
+    k--;
+    half = (struct run*)P2V((pfn + (1 << k)) * PGSIZE);
+    half->next = kmem.area[k].next;
+    half->prev = &kmem.area[k];
+    half->next->prev = half;
+    kmem.area[k].next = half;
+    kmem.order[pfn + (1 << k)] = k + 1;
+    kmem.nfree += 1 << k;
+  }
+  return (char*)r;
+}
+
+// Smallest order whose block holds n pages.
+static int
+npages2order(int n)
+{
+  int order;
+
+  for(order = 0; (1 << order) < n; order++)
+    ;
+  return order;
+}
+
 //PAGEBREAK: 21
 // Free the page of physical memory pointed at by v,
 // which normally should have been returned by a
@@ -59,21 +168,38 @@ freerange(void *vstart, void *vend)
 void
 kfree(char *v)
 {
+  struct cpucache *c;
   struct run *r;
+  int i;
 
   if((uint)v % PGSIZE || v < end || V2P(v) >= PHYSTOP)
     panic("kfree");
 
-  // Fill with junk to catch dangling refs.
-  memset(v, 1, PGSIZE);
+  if(KJUNK)
+    memset(v, 1, PGSIZE);  // Fill with junk to catch dangling refs.
 
-  if(kmem.use_lock)
-    acquire(&kmem.lock);
+  if(!kmem.use_lock){
+    buddyfree(v, 0);
+    return;
+  }
+
+  pushcli();
+  c = &kmem.cpu[cpuid()];
   r = (struct run*)v;
-  r->next = kmem.freelist;
-  kmem.freelist = r;
-  if(kmem.use_lock)
+  r->next = c->free;
+  c->free = r;
+  if(++c->n > KCACHEMAX){
+    acquire(&kmem.lock);
+    for(i = 0; i < KBATCH; i++){
+      r = c->free;
+      c->free = r->next;
+      c->n--;
+      buddyfree((char*)r, 0);
+    }
+    kmem.drains++;
     release(&kmem.lock);
+  }
+  popcli();
 }
 
 // Allocate one 4096-byte page of physical memory.
@@ -82,15 +208,109 @@ kfree(char *v)
 char*
 kalloc(void)
 {
+  struct cpucache *c;
   struct run *r;
+  char *v;
+
+  if(!kmem.use_lock)
+    return buddyalloc(0);
+
+  pushcli();
+  c = &kmem.cpu[cpuid()];
+  if(c->n == 0){
+    acquire(&kmem.lock);
+    while(c->n < KBATCH && (v = buddyalloc(0)) != 0){
+      r = (struct run*)v;
+      r->next = c->free;
+      c->free = r;
+      c->n++;
+    }
+    kmem.refills++;
+    release(&kmem.lock);
+  }
+  if((r = c->free) != 0){
+    c->free = r->next;
+    c->n--;
+  }
+  popcli();
+  return (char*)r;
+}
+
+// Allocate n physically contiguous pages, aligned to their
+// size rounded up to a power of two, which is what is used.
+// Returns 0 if there is no free run that big.
+char*
+kallocn(int n)
+{
+  char *v;
 
+  if(n > (1 << MAXORDER))
+    return 0;
   if(kmem.use_lock)
     acquire(&kmem.lock);
-  r = kmem.freelist;
-  if(r)
-    kmem.freelist = r->next;
+  v = buddyalloc(npages2order(n));
   if(kmem.use_lock)
     release(&kmem.lock);
-  return (char*)r;
+  return v;
 }
 
+// Free n pages allocated together by kallocn(n).
+void
+kfreen(char *v, int n)
+{
+  int order;
+
+  order = npages2order(n);
+  if(PFN(v) % (1 << order) || v < end || V2P(v) + (PGSIZE << order) > PHYSTOP)
+    panic("kfreen");
+
+  if(KJUNK)
+    memset(v, 1, PGSIZE << order);
+
+  if(kmem.use_lock)
+    acquire(&kmem.lock);
+  buddyfree(v, order);
+  if(kmem.use_lock)
+    release(&kmem.lock);
+}
+
+// Number of free pages, for sizing caches at boot.
+int
+kfreecount(void)
+{
+  int i, n;
+
+  n = kmem.nfree;
+  for(i = 0; i < NCPU; i++)
+    n += kmem.cpu[i].n;
+  return n;
+}
+
+int
+get_meminfo_file_string(char* dst)
+{
+  struct run *r;
+  int off = 0;
+  int k, n;
+
+  char free_str[] = "Free pages: ";
+  off+=add_string_number(dst,off,free_str,kfreecount(),add_space);
+  char cached_str[] = "Cached on CPUs: ";
+  off+=add_string_number(dst,off,cached_str,kfreecount()-kmem.nfree,add_space);
+  char refills_str[] = "Refills: ";
+  off+=add_string_number(dst,off,refills_str,kmem.refills,add_space);
+  char drains_str[] = "Drains: ";
+  off+=add_string_number(dst,off,drains_str,kmem.drains,add_space);
+  acquire(&kmem.lock);
+  for(k = 0; k <= MAXORDER; k++){
+    n = 0;
+    for(r = kmem.area[k].next; r != &kmem.area[k]; r = r->next)
+      n++;
+    char order_str[] = "Free blocks of order ";
+    off+=add_string_number(dst,off,order_str,k,no_space);
+    char count_str[] = ": ";
+    off+=add_string_number(dst,off,count_str,n,add_space);
+  }
+  release(&kmem.lock);
+  return off;
+}
@@ -42,6 +42,7 @@
 #define TDCR    (0x03E0/4)   // Timer Divide Configuration
 
 volatile uint *lapic;  // Initialized in mp.c
+static uint timercount;  // timer count for one jiffy
 
 //PAGEBREAK!
 static void
@@ -61,12 +62,21 @@ lapicinit(void)
   lapicw(SVR, ENABLE | (T_IRQ0 + IRQ_SPURIOUS));
 
   // The timer repeatedly counts down at bus frequency
-  // from lapic[TICR] and then issues an interrupt.
-  // If xv6 cared more about precise timekeeping,
-  // TICR would be calibrated using an external time source.
+  // from lapic[TICR] and then issues an interrupt, once
+  // a jiffy: 1/WHEELHZ of a second as timed by the TSC.
+  // The first CPU finds the count, by letting the timer
+  // count down for 10ms with its interrupt masked.
   lapicw(TDCR, X1);
+  if(timercount == 0){
+    lapicw(TIMER, MASKED);
+    lapicw(TICR, 0xFFFFFFFF);
+    if(tscdelay(10000) == 0)
+      timercount = (0xFFFFFFFF - lapic[TCCR]) / (WHEELHZ / 100);
+    if(timercount == 0)
+      timercount = 10000000 / TICKDIV;  // no TSC timing to go by
+  }
   lapicw(TIMER, PERIODIC | (T_IRQ0 + IRQ_TIMER));
-  lapicw(TICR, 10000000);
+  lapicw(TICR, timercount);
 
   // Disable logical interrupt lines.
   lapicw(LINT0, MASKED);
@@ -114,10 +124,10 @@ lapiceoi(void)
 }
 
 // Spin for a given number of microseconds.
-// On real hardware would want to tune this dynamically.
 void
 microdelay(int us)
 {
+  tscdelay(us);
 }
 
 #define CMOS_PORT    0x70
@@ -1,6 +1,7 @@
 #include "types.h"
 #include "defs.h"
 #include "param.h"
+#include "mmu.h"
 #include "spinlock.h"
 #include "sleeplock.h"
 #include "fs.h"
@@ -9,50 +10,101 @@
 // Simple logging that allows concurrent FS system calls.
 //
 // A log transaction contains the updates of multiple FS system
-// calls. The logging system only commits when there are
-// no FS system calls active. Thus there is never
-// any reasoning required about whether a commit might
-// write an uncommitted system call's updates to disk.
+// calls. A transaction is only closed when there are no FS
+// system calls active in it. Thus there is never any reasoning
+// required about whether a commit might write an uncommitted
+// system call's updates to disk.
 //
 // A system call should call begin_op()/end_op() to mark
 // its start and end. Usually begin_op() just increments
 // the count of in-progress FS system calls and returns.
 // But if it thinks the log is close to running out, it
-// sleeps until the last outstanding end_op() commits.
+// sleeps until the commit thread has taken the transaction.
+//
+// Commits are done by a kernel thread (committer). Once the
+// open transaction has no system calls in it, the committer
+// copies its blocks aside and opens a new transaction, so
+// system calls go on filling the next transaction while the
+// previous one is written to disk. Everything the system calls
+// did while a commit was running goes out in one group commit.
+//
+// A commit only appends the transaction to the log. Writing
+// the blocks to their home locations (checkpointing) is left
+// to a second kernel thread (checkpointer), which does it for
+// many transactions at once in the background, and then frees
+// their log space. A block that a later transaction logs again
+// is only written home once.
 //
 // The log is a physical re-do log containing disk blocks.
 // The on-disk log format:
-//   header block, containing block #s for block A, B, C, ...
-//   block A
-//   block B
-//   block C
-//   ...
-// Log appends are synchronous.
-
-// Contents of the header block, used for both the on-disk header block
-// and to keep track in memory of logged block# before commit.
+//   log super block: where the oldest live transaction starts
+//   circular area of slots, holding transactions one after
+//   another, each made of:
+//     header block, containing seq and block #s for A, B, C, ...
+//     block A
+//     block B
+//     block C
+//     ...
+// A transaction never wraps around the end of the area; if it
+// does not fit, it starts over at slot 0. Its header is written
+// after its blocks, and a header with the expected seq is the
+// true point at which the transaction commits.
+// mkfs decides how many blocks the log has.
+
+#define LOG_MAGIC 0x10c5eed5
+
+// Contents of a transaction's header block, also used in memory
+// to keep track of logged block# before commit.
 struct logheader {
+  uint magic;
+  uint seq;
   int n;
   int block[LOGSIZE];
 };
 
+// Contents of the log super block.
+struct logsuper {
+  uint magic;
+  uint tail;  // slot of the oldest transaction not checkpointed
+  uint seq;   // its seq
+};
+
 struct log {
   struct spinlock lock;
   int start;
   int size;
+  int nslot;       // slots in the circular area
+  int maxtrans;    // most blocks one transaction may log
   int outstanding; // how many FS sys calls are executing.
-  int committing;  // in commit(), please wait.
+  int freezing;    // committer is copying the transaction aside.
+  int urgent;      // committer is waiting for log space.
+  int committing;  // committer is writing a transaction.
   int dev;
-  struct logheader lh;
+  struct logheader lh;   // the open transaction
+  uint head;       // slot count after the last committed transaction
+  uint tail;       // slot count of the oldest one not checkpointed
+  uint seq;        // seq of the next transaction to commit
+  struct buf *slot[LOGSIZE];   // private copy of each slot's block
+  struct buf *cached[LOGSIZE]; // a data slot's block, pinned in the cache
+  uint home[LOGSIZE];          // a data slot's block #, or 0
+  uint commits;
+  uint checkpoints;
+  uint installed;  // blocks written home
+  uint absorbed;   // blocks not written home, logged again later
 };
 struct log log;
 
 static void recover_from_log(void);
-static void commit();
+static void committer(void);
+static void checkpointer(void);
 
 void
 initlog(int dev)
 {
+  struct buf *b;
+  char *page = 0;
+  int i, perpage;
+
   if (sizeof(struct logheader) >= BSIZE)
     panic("initlog: too big logheader");
 
@@ -62,63 +114,123 @@ initlog(int dev)
   log.start = sb.logstart;
   log.size = sb.nlog;
   log.dev = dev;
+  log.nslot = log.size - 1;
+  // Leave room for another transaction to be checkpointed.
+  log.maxtrans = log.nslot/2 - 1;
+  if(log.nslot > LOGSIZE || log.maxtrans < MAXOPBLOCKS)
+    panic("initlog: bad log size");
+
+  // Private buffers for the log slots, kept out of the buffer
+  // cache so the log blocks never displace cached blocks.
+  perpage = PGSIZE / sizeof(struct buf);
+  for(i = 0; i < log.nslot; i++){
+    if(i % perpage == 0 && (page = kalloc()) == 0)
+      panic("initlog");
+    b = (struct buf*)page + i % perpage;
+    memset(b, 0, sizeof(*b));
+    initsleeplock(&b->lock, "logbuf");
+    b->dev = dev;
+    log.slot[i] = b;
+  }
+
   recover_from_log();
+  kproc("commit", committer);
+  kproc("checkpoint", checkpointer);
 }
 
-// Copy committed blocks from log to their home location
+// Start the disk I/O for slot buffer b, as a read of log slot
+// pos, a write of log slot pos, or a write of home block home.
 static void
-install_trans(void)
+slot_start(struct buf *b, int pos, int write, uint home)
 {
-  int tail;
-
-  for (tail = 0; tail < log.lh.n; tail++) {
-    struct buf *lbuf = bread(log.dev, log.start+tail+1); // read log block
-    struct buf *dbuf = bread(log.dev, log.lh.block[tail]); // read dst
-    memmove(dbuf->data, lbuf->data, BSIZE);  // copy block to dst
-    bwrite(dbuf);  // write dst to disk
-    brelse(lbuf);
-    brelse(dbuf);
-  }
+  b->blockno = home ? home : log.start+1+pos;
+  b->flags = write ? B_VALID|B_DIRTY : 0;
+  iderw_start(b);
 }
 
-// Read the log header from disk into the in-memory log header
 static void
-read_head(void)
+read_super(struct logsuper *ls)
 {
   struct buf *buf = bread(log.dev, log.start);
-  struct logheader *lh = (struct logheader *) (buf->data);
-  int i;
-  log.lh.n = lh->n;
-  for (i = 0; i < log.lh.n; i++) {
-    log.lh.block[i] = lh->block[i];
-  }
+  memmove(ls, buf->data, sizeof(*ls));
   brelse(buf);
 }
 
-// Write in-memory log header to disk.
-// This is the true point at which the
-// current transaction commits.
+// Record where the log now starts. Blocks of transactions
+// before ls->tail must already be home.
 static void
-write_head(void)
+write_super(struct logsuper *ls)
 {
   struct buf *buf = bread(log.dev, log.start);
-  struct logheader *hb = (struct logheader *) (buf->data);
-  int i;
-  hb->n = log.lh.n;
-  for (i = 0; i < log.lh.n; i++) {
-    hb->block[i] = log.lh.block[i];
-  }
+  memmove(buf->data, ls, sizeof(*ls));
   bwrite(buf);
   brelse(buf);
 }
 
+// Read the header in slot pos; return its block count if it is
+// the header of transaction seq, else -1.
+static int
+read_head(int pos, uint seq)
+{
+  struct buf *b = log.slot[pos];
+  struct logheader *lh = (struct logheader *) (b->data);
+
+  slot_start(b, pos, 0, 0);
+  iderw_wait(b);
+  if(lh->magic != LOG_MAGIC || lh->seq != seq ||
+     lh->n < 0 || pos + 1 + lh->n > log.nslot)
+    return -1;
+  return lh->n;
+}
+
+// Replay every committed transaction from the tail on, in order,
+// then mark the log empty.
 static void
 recover_from_log(void)
 {
-  read_head();
-  install_trans(); // if committed, copy from log to disk
-  log.lh.n = 0;
-  write_head(); // clear the log
+  struct logsuper ls;
+  struct logheader *lh;
+  int i, n, pos;
+  uint seq;
+
+  for (i = 0; i < log.nslot; i++)
+    acquiresleep(&log.slot[i]->lock);
+
+  read_super(&ls);
+  if(ls.magic != LOG_MAGIC || ls.tail >= log.nslot){
+    ls.tail = 0;   // a fresh file system
+    ls.seq = 1;
+  }
+  pos = ls.tail;
+  for(seq = ls.seq; ; seq++){
+    if((n = read_head(pos, seq)) < 0){
+      if(pos == 0 || (n = read_head(0, seq)) < 0)
+        break;
+      pos = 0;  // the transaction did not fit before the end
+    }
+    lh = (struct logheader *) (log.slot[pos]->data);
+    for (i = 0; i < n; i++)
+      slot_start(log.slot[pos+1+i], pos+1+i, 0, 0);  // read log block
+    for (i = 0; i < n; i++)
+      iderw_wait(log.slot[pos+1+i]);
+    for (i = 0; i < n; i++)
+      slot_start(log.slot[pos+1+i], pos+1+i, 1, lh->block[i]); // install
+    for (i = 0; i < n; i++)
+      iderw_wait(log.slot[pos+1+i]);
+    pos += 1 + n;
+    if(pos == log.nslot)
+      pos = 0;
+  }
+
+  ls.magic = LOG_MAGIC;
+  ls.tail = pos;
+  ls.seq = seq;
+  write_super(&ls); // clear the log
+  log.head = log.tail = pos;
+  log.seq = seq;
+
+  for (i = 0; i < log.nslot; i++)
+    releasesleep(&log.slot[i]->lock);
 }
 
 // called at the start of each FS system call.
@@ -127,9 +239,9 @@ begin_op(void)
 {
   acquire(&log.lock);
   while(1){
-    if(log.committing){
+    if(log.freezing){
       sleep(&log, &log.lock);
-    } else if(log.lh.n + (log.outstanding+1)*MAXOPBLOCKS > LOGSIZE){
+    } else if(log.lh.n + (log.outstanding+1)*MAXOPBLOCKS > log.maxtrans){
       // this op might exhaust log space; wait for commit.
       sleep(&log, &log.lock);
     } else {
@@ -141,69 +253,226 @@ begin_op(void)
 }
 
 // called at the end of each FS system call.
-// commits if this was the last outstanding operation.
+// hands the transaction to the committer if this was
+// the last outstanding operation.
 void
 end_op(void)
 {
-  int do_commit = 0;
-
   acquire(&log.lock);
   log.outstanding -= 1;
-  if(log.committing)
-    panic("log.committing");
-  if(log.outstanding == 0){
-    do_commit = 1;
-    log.committing = 1;
-  } else {
-    // begin_op() may be waiting for log space,
-    // and decrementing log.outstanding has decreased
-    // the amount of reserved space.
-    wakeup(&log);
+  if(log.freezing)
+    panic("log.freezing");
+  if(log.outstanding == 0 && log.lh.n > 0)
+    wakeup(&log.lh);
+  // begin_op() may be waiting for log space,
+  // and decrementing log.outstanding has decreased
+  // the amount of reserved space.
+  wakeup(&log);
+  release(&log.lock);
+}
+
+// Wait until the system calls that have finished are committed,
+// for fsync(). The caller must not be in a transaction.
+void
+log_sync(void)
+{
+  uint seq;
+
+  acquire(&log.lock);
+  if(log.lh.n > 0)
+    // the open transaction, unless commit() is freezing it
+    seq = log.seq + (log.committing && !log.freezing);
+  else if(log.committing)
+    seq = log.seq;
+  else {
+    release(&log.lock);
+    return;
   }
+  while((int)(log.seq - seq) <= 0)
+    sleep(&log.seq, &log.lock);
   release(&log.lock);
+}
 
-  if(do_commit){
-    // call commit w/o holding locks, since not allowed
-    // to sleep with locks.
-    commit();
-    acquire(&log.lock);
+// Commit the open transaction, which has no system calls in it,
+// to the slots after its header in slot pos. Called and returns
+// with log.lock held.
+static void
+commit(int pos)
+{
+  struct logheader *lh;
+  struct buf *b;
+  int i, n;
+
+  // Hold off new system calls, so that the copy below holds
+  // exactly what the transaction wrote, and take the slots
+  // without log.lock, as acquiresleep() may sleep.
+  n = log.lh.n;
+  log.freezing = 1;
+  release(&log.lock);
+  for (i = 0; i <= n; i++)
+    acquiresleep(&log.slot[pos+i]->lock);
+
+  // Copy the blocks from the cache.
+  acquire(&log.lock);
+  lh = (struct logheader *) (log.slot[pos]->data);
+  *lh = log.lh;
+  lh->magic = LOG_MAGIC;
+  lh->seq = log.seq;
+  log.lh.n = 0;
+  release(&log.lock);
+
+  for (i = 0; i < n; i++) {
+    b = bread(log.dev, lh->block[i]); // cache block, pinned
+    memmove(log.slot[pos+1+i]->data, b->data, BSIZE);
+    log.cached[pos+1+i] = b;
+    log.home[pos+1+i] = lh->block[i];
+    brelse(b);
+  }
+
+  acquire(&log.lock);
+  log.freezing = 0;
+  wakeup(&log);
+  release(&log.lock);
+
+  for (i = 1; i <= n; i++)
+    slot_start(log.slot[pos+i], pos+i, 1, 0);  // write the log
+  for (i = 1; i <= n; i++)
+    iderw_wait(log.slot[pos+i]);
+  slot_start(log.slot[pos], pos, 1, 0);  // write header -- the real commit
+  iderw_wait(log.slot[pos]);
+
+  for (i = 0; i <= n; i++)
+    releasesleep(&log.slot[pos+i]->lock);
+  acquire(&log.lock);
+}
+
+// The commit thread. Commits the open transaction whenever it
+// holds changes and no system call is in the middle of it.
+// It sleeps on &log.head for log space; the checkpointer
+// sleeps on &log.tail for committed transactions.
+static void
+committer(void)
+{
+  uint pos, skip, n;
+
+  acquire(&log.lock);
+  for(;;){
+    if(log.lh.n == 0 || log.outstanding > 0){
+      sleep(&log.lh, &log.lock);
+      continue;
+    }
+
+    // Find room for the header and the blocks before the end
+    // of the area, waiting for the checkpointer if need be.
+    n = log.lh.n;
+    pos = log.head % log.nslot;
+    skip = (pos + 1 + n > log.nslot) ? log.nslot - pos : 0;
+    if(log.head + skip + 1 + n - log.tail > log.nslot){
+      log.urgent = 1;
+      wakeup(&log.tail);
+      sleep(&log.head, &log.lock);
+      continue;
+    }
+    if(skip)
+      pos = 0;
+
+    log.committing = 1;
+    commit(pos);
     log.committing = 0;
-    wakeup(&log);
-    release(&log.lock);
+    log.head += skip + 1 + n;
+    log.seq++;
+    log.commits++;
+    wakeup(&log.tail);
+    wakeup(&log.seq);
   }
 }
 
-// Copy modified blocks from cache to log.
+// Write the blocks of the committed transactions in slots
+// [tail, head) home, then free their log space.
 static void
-write_log(void)
+checkpoint(uint tail, uint head, uint seq)
 {
-  int tail;
-
-  for (tail = 0; tail < log.lh.n; tail++) {
-    struct buf *to = bread(log.dev, log.start+tail+1); // log block
-    struct buf *from = bread(log.dev, log.lh.block[tail]); // cache block
-    memmove(to->data, from->data, BSIZE);
-    bwrite(to);  // write the log
-    brelse(from);
-    brelse(to);
+  struct logsuper ls;
+  uint c, d, pos;
+  int absorbed = 0, installed = 0;
+
+  for (c = tail; c != head; c++) {
+    pos = c % log.nslot;
+    if (log.home[pos] == 0)
+      continue;  // a header or an unused slot
+    for (d = c+1; d != head; d++)
+      if (log.home[d % log.nslot] == log.home[pos])
+        break;
+    acquiresleep(&log.slot[pos]->lock);
+    if (d != head) {
+      absorbed++;  // a later transaction has a newer copy
+      continue;
+    }
+    slot_start(log.slot[pos], pos, 1, log.home[pos]);
+    installed++;
   }
+  for (c = tail; c != head; c++) {
+    pos = c % log.nslot;
+    if (log.home[pos] == 0)
+      continue;
+    iderw_wait(log.slot[pos]);
+    releasesleep(&log.slot[pos]->lock);
+  }
+
+  ls.magic = LOG_MAGIC;
+  ls.tail = head % log.nslot;
+  ls.seq = seq;
+  write_super(&ls);
+
+  acquire(&log.lock);
+  for (c = tail; c != head; c++) {
+    pos = c % log.nslot;
+    if (log.home[pos] == 0)
+      continue;
+    bunpin(log.cached[pos]); // home copy is current; may evict
+    log.home[pos] = 0;
+  }
+  log.tail = head;
+  log.urgent = 0;
+  log.checkpoints++;
+  log.installed += installed;
+  log.absorbed += absorbed;
+  wakeup(&log.head);
+  release(&log.lock);
 }
 
+// The checkpoint thread. Lets committed transactions collect for
+// CKPTDELAY ticks, or until the committer runs out of log space,
+// and then checkpoints all of them.
 static void
-commit()
+checkpointer(void)
 {
-  if (log.lh.n > 0) {
-    write_log();     // Write modified blocks from cache to log
-    write_head();    // Write header to disk -- the real commit
-    install_trans(); // Now install writes to home locations
-    log.lh.n = 0;
-    write_head();    // Erase the transaction from the log
+  uint tail, head, seq, ticks0;
+
+  for(;;){
+    acquire(&log.lock);
+    while(log.tail == log.head)
+      sleep(&log.tail, &log.lock);
+    release(&log.lock);
+
+    acquire(&tickslock);
+    ticks0 = ticks;
+    while(ticks - ticks0 < CKPTDELAY && !log.urgent)
+      sleep(&ticks, &tickslock);
+    release(&tickslock);
+
+    acquire(&log.lock);
+    tail = log.tail;
+    head = log.head;
+    seq = log.seq;
+    release(&log.lock);
+    checkpoint(tail, head, seq);
   }
 }
 
 // Caller has modified b->data and is done with the buffer.
-// Record the block number and pin in the cache with B_DIRTY.
-// commit()/write_log() will do the disk write.
+// Record the block number and pin b in the cache.
+// The committer will do the disk write.
 //
 // log_write() replaces bwrite(); a typical use is:
 //   bp = bread(...)
@@ -215,7 +484,7 @@ log_write(struct buf *b)
 {
   int i;
 
-  if (log.lh.n >= LOGSIZE || log.lh.n >= log.size - 1)
+  if (log.lh.n >= log.maxtrans)
     panic("too big a transaction");
   if (log.outstanding < 1)
     panic("log_write outside of trans");
@@ -226,9 +495,31 @@ log_write(struct buf *b)
       break;
   }
   log.lh.block[i] = b->blockno;
-  if (i == log.lh.n)
+  if (i == log.lh.n) {
     log.lh.n++;
-  b->flags |= B_DIRTY; // prevent eviction
+    bpin(b); // prevent eviction until checkpointed
+  }
   release(&log.lock);
 }
 
+int
+get_loginfo_file_string(char* dst)
+{
+  int off = 0;
+
+  acquire(&log.lock);
+  char size_str[] = "Log slots: ";
+  off+=add_string_number(dst,off,size_str,log.nslot,add_space);
+  char used_str[] = "Slots in use: ";
+  off+=add_string_number(dst,off,used_str,log.head - log.tail,add_space);
+  char commits_str[] = "Commits: ";
+  off+=add_string_number(dst,off,commits_str,log.commits,add_space);
+  char checkpoints_str[] = "Checkpoints: ";
+  off+=add_string_number(dst,off,checkpoints_str,log.checkpoints,add_space);
+  char installed_str[] = "Blocks installed: ";
+  off+=add_string_number(dst,off,installed_str,log.installed,add_space);
+  char absorbed_str[] = "Blocks absorbed: ";
+  off+=add_string_number(dst,off,absorbed_str,log.absorbed,add_space);
+  release(&log.lock);
+  return off;
+}
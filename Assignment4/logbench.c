@@ -0,0 +1,55 @@
+// Metadata-heavy benchmark for the log: each op creates a file,
+// writes one block to it, closes it and unlinks it. Reports the
+// time per op and the log counters from /proc/loginfo.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fs.h"
+#include "fcntl.h"
+
+#define NOPS 200
+
+char data[BSIZE];
+
+void
+print_loginfo(void)
+{
+  char info[256];
+  int fd, n;
+
+  if((fd = open("/proc/loginfo", O_RDONLY)) < 0)
+    return;
+  if((n = read(fd, info, sizeof(info)-1)) > 0){
+    info[n] = 0;
+    printf(1, "%s", info);
+  }
+  close(fd);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int fd, i, start, ticks;
+  char path[] = "lb00";
+
+  memset(data, 'l', sizeof(data));
+  start = uptime();
+  for(i = 0; i < NOPS; i++){
+    path[2] = '0' + (i / 10) % 10;
+    path[3] = '0' + i % 10;
+    if((fd = open(path, O_CREATE | O_RDWR)) < 0){
+      printf(1, "logbench: cannot create %s\n", path);
+      exit();
+    }
+    write(fd, data, sizeof(data));
+    close(fd);
+    unlink(path);
+  }
+  ticks = uptime() - start;
+
+  printf(1, "logbench: %d create/write/unlink ops in %d ticks", NOPS, ticks);
+  printf(1, " (%d ticks per 100 ops)\n", ticks * 100 / NOPS);
+  print_loginfo();
+  exit();
+}
@@ -8,18 +8,27 @@
 
 static void startothers(void);
 static void mpmain(void)  __attribute__((noreturn));
+static void savecmdline(void);
 extern pde_t *kpgdir;
 extern char end[]; // first address after kernel loaded from ELF file
 
+#define MBMAGIC   0x2BADB002  // in eax when a multiboot loader started us
+#define MBCMDLINE (1<<2)      // multiboot info has a command line
+
+uint mbmagic, mbinfo;   // eax and ebx at entry, set in entry.S
+static char cmdline[128];
+
 // Bootstrap processor starts running C code here.
 // Allocate a real stack and switch to it, first
 // doing some setup required for memory allocator to work.
 int
 main(void)
 {
+  savecmdline();   // before kinit1() reuses the memory it is in
   kinit1(end, P2V(4*1024*1024)); // phys page allocator
   kvmalloc();      // kernel page table
   mpinit();        // detect other processors
+  clockinit();     // time the TSC; timer wheel
   lapicinit();     // interrupt controller
   seginit();       // segment descriptors
   picinit();       // disable pic
@@ -29,15 +38,48 @@ main(void)
   uartinit();      // serial port
   pinit();         // process table
   tvinit();        // trap vectors
-  binit();         // buffer cache
+  slabinit();      // slab caches
   fileinit();      // file table
+  pipeinit();      // pipe cache
   ideinit();       // disk 
   startothers();   // start other processors
   kinit2(P2V(4*1024*1024), P2V(PHYSTOP)); // must come after startothers()
+  binit();         // buffer cache, sized from free memory
+  pcinit();        // page cache for mapped files
   userinit();      // first user process
   mpmain();        // finish this processor's setup
 }
 
+// Copy the command line a multiboot loader passed, as in
+// qemu -kernel kernel -append "ide=pio". The bootblock passes none.
+static void
+savecmdline(void)
+{
+  uint *info;
+
+  if(mbmagic != MBMAGIC)
+    return;
+  info = P2V(mbinfo);
+  if(info[0] & MBCMDLINE)
+    safestrcpy(cmdline, P2V(info[4]), sizeof(cmdline));
+}
+
+// Is word one of the words of the boot command line?
+int
+bootopt(char *word)
+{
+  char *p;
+  int n;
+
+  n = strlen(word);
+  for(p = cmdline; *p; p++){
+    if((p == cmdline || p[-1] == ' ') && strncmp(p, word, n) == 0 &&
+       (p[n] == ' ' || p[n] == 0))
+      return 1;
+  }
+  return 0;
+}
+
 // Other CPUs jump here from entryother.S.
 static void
 mpenter(void)
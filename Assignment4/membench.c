@@ -0,0 +1,70 @@
+// Page allocator benchmark: NCHILD processes, which the
+// scheduler spreads over the CPUs, each grow and shrink their
+// heap with sbrk and fork short-lived children, so every CPU
+// allocates and frees pages at once. Reports the ticks taken
+// and how often the CPUs went to the shared buddy lists
+// (refills and drains in /proc/meminfo) per page allocated.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+
+#define NCHILD 4
+#define ROUNDS 200
+#define NPAGES 32    // pages each sbrk round grows the heap by
+#define NFORKS 20
+#define PGSIZE 4096
+
+void
+work(void)
+{
+  char *p;
+  int i, j, pid;
+
+  for(i = 0; i < ROUNDS; i++){
+    if((p = sbrk(NPAGES * PGSIZE)) == (char*)-1){
+      printf(1, "membench: sbrk failed\n");
+      exit();
+    }
+    for(j = 0; j < NPAGES; j++)
+      p[j * PGSIZE] = j;
+    sbrk(-NPAGES * PGSIZE);
+  }
+  for(i = 0; i < NFORKS; i++){
+    if((pid = fork()) < 0){
+      printf(1, "membench: fork failed\n");
+      exit();
+    }
+    if(pid == 0)
+      exit();
+    wait();
+  }
+}
+
+int
+main(int argc, char *argv[])
+{
+  int i, start, ticks, refills, drains, pages;
+
+  refills = procinfo("/proc/meminfo", "Refills: ");
+  drains = procinfo("/proc/meminfo", "Drains: ");
+  start = uptime();
+  for(i = 0; i < NCHILD; i++){
+    if(fork() == 0){
+      work();
+      exit();
+    }
+  }
+  for(i = 0; i < NCHILD; i++)
+    wait();
+  ticks = uptime() - start;
+  refills = procinfo("/proc/meminfo", "Refills: ") - refills;
+  drains = procinfo("/proc/meminfo", "Drains: ") - drains;
+
+  pages = NCHILD * ROUNDS * NPAGES;
+  printf(1, "membench: %d procs, %d sbrk pages and %d forks each in %d ticks\n",
+         NCHILD, ROUNDS * NPAGES, NFORKS, ticks);
+  printf(1, "membench: %d refills and %d drains of the shared free lists (%d per 1000 sbrk pages)\n",
+         refills, drains, (refills + drains) * 1000 / pages);
+  exit();
+}
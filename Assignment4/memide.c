@@ -58,3 +58,15 @@ iderw(struct buf *b)
     memmove(b->data, p, BSIZE);
   b->flags |= B_VALID;
 }
+
+// The memory disk finishes every request at once.
+void
+iderw_start(struct buf *b)
+{
+  iderw(b);
+}
+
+void
+iderw_wait(struct buf *b)
+{
+}
@@ -16,11 +16,13 @@
 #endif
 
 // Disk layout:
-// [ boot block | sb block | log | inode blocks | free bit map | data blocks ]
+// [ boot block | sb block | log | group 0 | group 1 | ... ]
+// with each group laid out as
+// [ free bit map block | inode blocks | data blocks ]
 
-int nbitmap = FSSIZE/(BSIZE*8) + 1;
-int ninodeblocks = NINODES / IPB + 1;
-int nlog = LOGSIZE;
+int ngroups;  // Number of block groups
+int ipg;      // Inodes per group
+int nlog;     // Number of log blocks, header included
 int nmeta;    // Number of meta blocks (boot, sb, nlog, inode, bitmap)
 int nblocks;  // Number of data blocks
 
@@ -31,13 +33,17 @@ uint freeinode = 1;
 uint freeblock;
 
 
-void balloc(int);
+void balloc(void);
+uint nextblock(void);
 void wsect(uint, void*);
 void winode(uint, struct dinode*);
 void rinode(uint inum, struct dinode *ip);
 void rsect(uint sec, void *buf);
 uint ialloc(ushort type);
 void iappend(uint inum, void *p, int n);
+uint iindex(uint ind, uint i);
+uint ibmap(struct dinode *din, uint fbn);
+void dirappend(uint dinum, struct dirent *de);
 
 // convert to intel byte order
 ushort
@@ -88,22 +94,42 @@ main(int argc, char *argv[])
     exit(1);
   }
 
+  // The log gets a tenth of the disk, as much as one header
+  // block can describe.
+  nlog = FSSIZE / 10;
+  if(nlog > LOGSIZE + 1)
+    nlog = LOGSIZE + 1;
+  assert(nlog > MAXOPBLOCKS*3);
+
+  // One bitmap block per group, and the inodes spread evenly
+  // over the groups a whole inode block at a time.
+  ngroups = (FSSIZE - 2 - nlog + BPB - 1) / BPB;
+  assert(ngroups <= MAXGROUPS);
+  ipg = NINODES / ngroups / IPB * IPB;
+
   // 1 fs block = 1 disk sector
-  nmeta = 2 + nlog + ninodeblocks + nbitmap;
+  nmeta = 2 + nlog + ngroups * (1 + ipg / IPB);
   nblocks = FSSIZE - nmeta;
 
   sb.size = xint(FSSIZE);
   sb.nblocks = xint(nblocks);
-  sb.ninodes = xint(NINODES);
+  sb.ninodes = xint(ipg * ngroups);
   sb.nlog = xint(nlog);
   sb.logstart = xint(2);
-  sb.inodestart = xint(2+nlog);
-  sb.bmapstart = xint(2+nlog+ninodeblocks);
+  sb.inodestart = xint(2+nlog+1);
+  sb.bmapstart = xint(2+nlog);
+  sb.ngroups = xint(ngroups);
+  sb.groupstart = xint(2+nlog);
+  sb.bpg = xint(BPB);
+  sb.ipg = xint(ipg);
 
-  printf("nmeta %d (boot, super, log blocks %u inode blocks %u, bitmap blocks %u) blocks %d total %d\n",
-         nmeta, nlog, ninodeblocks, nbitmap, nblocks, FSSIZE);
+  // The last group must hold at least its own metadata.
+  assert(GDATA(ngroups - 1, sb) < FSSIZE);
 
-  freeblock = nmeta;     // the first free block that we can allocate
+  printf("nmeta %d (boot, super, log blocks %u, %d groups of %d inode blocks and 1 bitmap block) blocks %d total %d\n",
+         nmeta, nlog, ngroups, (int)(ipg / IPB), nblocks, FSSIZE);
+
+  freeblock = GDATA(0, sb);  // the first free block that we can allocate
 
   for(i = 0; i < FSSIZE; i++)
     wsect(i, zeroes);
@@ -118,12 +144,12 @@ main(int argc, char *argv[])
   bzero(&de, sizeof(de));
   de.inum = xshort(rootino);
   strcpy(de.name, ".");
-  iappend(rootino, &de, sizeof(de));
+  dirappend(rootino, &de);
 
   bzero(&de, sizeof(de));
   de.inum = xshort(rootino);
   strcpy(de.name, "..");
-  iappend(rootino, &de, sizeof(de));
+  dirappend(rootino, &de);
 
   for(i = 2; i < argc; i++){
     assert(index(argv[i], '/') == 0);
@@ -145,7 +171,7 @@ main(int argc, char *argv[])
     bzero(&de, sizeof(de));
     de.inum = xshort(inum);
     strncpy(de.name, argv[i], DIRSIZ);
-    iappend(rootino, &de, sizeof(de));
+    dirappend(rootino, &de);
 
     while((cc = read(fd, buf, sizeof(buf))) > 0)
       iappend(inum, buf, cc);
@@ -155,12 +181,14 @@ main(int argc, char *argv[])
 
   // fix size of root inode dir
   rinode(rootino, &din);
-  off = xint(din.size);
-  off = ((off/BSIZE) + 1) * BSIZE;
-  din.size = xint(off);
-  winode(rootino, &din);
+  if(din.addrs[DIRINDEX] == 0){
+    off = xint(din.size);
+    off = ((off/BSIZE) + 1) * BSIZE;
+    din.size = xint(off);
+    winode(rootino, &din);
+  }
 
-  balloc(freeblock);
+  balloc();
 
   exit(0);
 }
@@ -232,24 +260,85 @@ ialloc(ushort type)
   return inum;
 }
 
+// Return the next data block, stepping over the metadata
+// at the start of each group.
+uint
+nextblock(void)
+{
+  uint g;
+
+  g = BGROUP(freeblock, sb);
+  if(freeblock == GSTART(g, sb))
+    freeblock = GDATA(g, sb);
+  assert(freeblock < FSSIZE);
+  return freeblock++;
+}
+
+// Write each group's free map: its metadata and every block
+// handed out before freeblock are in use, as are the bits of
+// the last group that lie past the end of the disk.
 void
-balloc(int used)
+balloc(void)
 {
   uchar buf[BSIZE];
-  int i;
-
-  printf("balloc: first %d blocks have been allocated\n", used);
-  assert(used < BSIZE*8);
-  bzero(buf, BSIZE);
-  for(i = 0; i < used; i++){
-    buf[i/8] = buf[i/8] | (0x1 << (i%8));
+  uint g, b;
+
+  printf("balloc: first %d blocks have been allocated\n", freeblock);
+  for(g = 0; g < ngroups; g++){
+    bzero(buf, BSIZE);
+    for(b = GSTART(g, sb); b < GSTART(g+1, sb); b++){
+      if(b < GDATA(g, sb) || b < freeblock || b >= FSSIZE)
+        buf[BBIT(b, sb)/8] |= 0x1 << (BBIT(b, sb)%8);
+    }
+    printf("balloc: write bitmap block at sector %d\n", GSTART(g, sb));
+    wsect(GSTART(g, sb), buf);
   }
-  printf("balloc: write bitmap block at sector %d\n", sb.bmapstart);
-  wsect(sb.bmapstart, buf);
 }
 
 #define min(a, b) ((a) < (b) ? (a) : (b))
 
+// Return entry i of indirect block ind, allocating the block
+// the entry points to if necessary.
+uint
+iindex(uint ind, uint i)
+{
+  uint indirect[NINDIRECT];
+
+  rsect(ind, (char*)indirect);
+  if(indirect[i] == 0){
+    indirect[i] = xint(nextblock());
+    wsect(ind, (char*)indirect);
+  }
+  return xint(indirect[i]);
+}
+
+// Return the block holding file block fbn of din, allocating
+// it (and the indirect blocks on the way) if necessary.
+uint
+ibmap(struct dinode *din, uint fbn)
+{
+  uint x;
+
+  assert(fbn < MAXFILE);
+  if(fbn < NDIRECT){
+    if(xint(din->addrs[fbn]) == 0){
+      din->addrs[fbn] = xint(nextblock());
+    }
+    return xint(din->addrs[fbn]);
+  } else if(fbn < NDIRECT + NINDIRECT){
+    if(xint(din->addrs[NDIRECT]) == 0){
+      din->addrs[NDIRECT] = xint(nextblock());
+    }
+    return iindex(xint(din->addrs[NDIRECT]), fbn - NDIRECT);
+  } else {
+    if(xint(din->addrs[NDIRECT+1]) == 0){
+      din->addrs[NDIRECT+1] = xint(nextblock());
+    }
+    x = fbn - NDIRECT - NINDIRECT;
+    return iindex(iindex(xint(din->addrs[NDIRECT+1]), x / NINDIRECT), x % NINDIRECT);
+  }
+}
+
 void
 iappend(uint inum, void *xp, int n)
 {
@@ -257,7 +346,6 @@ iappend(uint inum, void *xp, int n)
   uint fbn, off, n1;
   struct dinode din;
   char buf[BSIZE];
-  uint indirect[NINDIRECT];
   uint x;
 
   rinode(inum, &din);
@@ -265,23 +353,7 @@ iappend(uint inum, void *xp, int n)
   // printf("append inum %d at off %d sz %d\n", inum, off, n);
   while(n > 0){
     fbn = off / BSIZE;
-    assert(fbn < MAXFILE);
-    if(fbn < NDIRECT){
-      if(xint(din.addrs[fbn]) == 0){
-        din.addrs[fbn] = xint(freeblock++);
-      }
-      x = xint(din.addrs[fbn]);
-    } else {
-      if(xint(din.addrs[NDIRECT]) == 0){
-        din.addrs[NDIRECT] = xint(freeblock++);
-      }
-      rsect(xint(din.addrs[NDIRECT]), (char*)indirect);
-      if(indirect[fbn - NDIRECT] == 0){
-        indirect[fbn - NDIRECT] = xint(freeblock++);
-        wsect(xint(din.addrs[NDIRECT]), (char*)indirect);
-      }
-      x = xint(indirect[fbn-NDIRECT]);
-    }
+    x = ibmap(&din, fbn);
     n1 = min(n, (fbn + 1) * BSIZE - off);
     rsect(x, buf);
     bcopy(p, buf + off - (fbn * BSIZE), n1);
@@ -293,3 +365,77 @@ iappend(uint inum, void *xp, int n)
   din.size = xint(off);
   winode(inum, &din);
 }
+
+// Hash bucket of a directory entry name; must match fs.c.
+uint
+dirhash(char *name)
+{
+  uint h;
+  int i;
+
+  h = 2166136261;
+  for(i = 0; i < DIRSIZ && name[i]; i++)
+    h = (h ^ (uchar)name[i]) * 16777619;
+  return h % NDIRBUCKET;
+}
+
+// Add entry de to directory dinum the way dirlink in fs.c does:
+// append it until the directory has NDIRLINEAR blocks, then
+// give it an index and put the entry in its name's hash chain.
+void
+dirappend(uint dinum, struct dirent *de)
+{
+  struct dinode din;
+  struct dirindex di;
+  struct dirent blk[DPB];
+  uint size, h, i, x, bn, link, prev;
+
+  rinode(dinum, &din);
+  size = xint(din.size);
+  if(din.addrs[DIRINDEX] == 0 && (size < NDIRLINEAR*BSIZE || size % BSIZE)){
+    iappend(dinum, de, sizeof(*de));
+    return;
+  }
+  if(din.addrs[DIRINDEX] == 0){
+    din.addrs[DIRINDEX] = xint(nextblock());
+    bzero(&di, sizeof(di));
+    di.nlinear = xint(size / BSIZE);
+    wsect(xint(din.addrs[DIRINDEX]), &di);
+  }
+
+  // Use a free entry in the chain if there is one.
+  rsect(xint(din.addrs[DIRINDEX]), &di);
+  h = dirhash(de->name);
+  prev = 0;
+  for(link = xint(di.bucket[h]); link != 0; memmove(&link, blk[DPB-1].name, sizeof(link))){
+    x = ibmap(&din, link - 1);
+    rsect(x, blk);
+    for(i = 0; i < DPB-1; i++){
+      if(blk[i].inum == 0){
+        blk[i] = *de;
+        wsect(x, blk);
+        winode(dinum, &din);
+        return;
+      }
+    }
+    prev = link;
+  }
+
+  // Otherwise start a new block and link it to the chain.
+  bn = size / BSIZE;
+  bzero(blk, sizeof(blk));
+  blk[0] = *de;
+  wsect(ibmap(&din, bn), blk);
+  din.size = xint((bn + 1) * BSIZE);
+  if(prev == 0){
+    di.bucket[h] = xint(bn + 1);
+    wsect(xint(din.addrs[DIRINDEX]), &di);
+  } else {
+    x = ibmap(&din, prev - 1);
+    rsect(x, blk);
+    link = xint(bn + 1);
+    memmove(blk[DPB-1].name, &link, sizeof(link));
+    wsect(x, blk);
+  }
+  winode(dinum, &din);
+}
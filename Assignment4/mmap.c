@@ -0,0 +1,292 @@
+// Memory-mapped files.
+//
+// mmap() reserves a range of the address space between
+// MMAPBASE and the vdso page (VDSO), above anything sbrk() can
+// reach, and records it in a vma of the process. Pages are mapped as they
+// are first touched, by vmafault() from the page fault handler.
+//
+// A MAP_SHARED mapping maps the page cache's own page (marked
+// PTE_SHARED, since the process does not own it), so processes
+// sharing a file see each other's stores. Pages the process
+// stored to are written to the file, through the page cache
+// like any write, when they are unmapped, which exit() and
+// exec() also do. A MAP_PRIVATE mapping gets its own copy of
+// each page.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "stat.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "x86.h"
+#include "proc.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "file.h"
+#include "fcntl.h"
+#include "clock.h"
+
+// The vma of p that holds [va, va+n), or 0.
+static struct vma*
+vmafind(struct proc *p, uint va, uint n)
+{
+  struct vma *v;
+
+  for(v = p->vma; v < &p->vma[NVMA]; v++)
+    if(v->start && va >= v->start && va + n <= v->end && va + n >= va)
+      return v;
+  return 0;
+}
+
+// Map len bytes of f from offset off into the current process,
+// and return the address, or -1.
+int
+mmap(struct file *f, uint len, int prot, int flags, uint off)
+{
+  struct proc *curproc = myproc();
+  struct vma *v, *free;
+  uint start;
+  int moved;
+
+  if(len == 0 || len > VDSO - MMAPBASE || off % PGSIZE)
+    return -1;
+  if(f->type != FD_INODE || f->ip->type != T_FILE)
+    return -1;
+  if(flags != MAP_SHARED && flags != MAP_PRIVATE)
+    return -1;
+  if((prot & PROT_READ) && !f->readable)
+    return -1;
+  if((prot & PROT_WRITE) && flags == MAP_SHARED && !f->writable)
+    return -1;
+  len = PGROUNDUP(len);
+
+  free = 0;
+  for(v = curproc->vma; v < &curproc->vma[NVMA]; v++)
+    if(v->start == 0 && free == 0)
+      free = v;
+  if(free == 0)
+    return -1;
+
+  // First fit above MMAPBASE.
+  start = MMAPBASE;
+  do {
+    moved = 0;
+    for(v = curproc->vma; v < &curproc->vma[NVMA]; v++){
+      if(v->start && v->start < start + len && start < v->end){
+        start = v->end;
+        moved = 1;
+      }
+    }
+  } while(moved && start + len <= VDSO);
+  if(start + len > VDSO || start + len < start)
+    return -1;
+
+  free->start = start;
+  free->end = start + len;
+  free->prot = prot;
+  free->flags = flags;
+  free->off = off;
+  free->f = filedup(f);
+  return start;
+}
+
+// Map the page holding va, which the current process touched
+// for the first time. Returns -1 if va is not in a mapping or
+// the page cannot be read.
+int
+vmafault(uint va)
+{
+  struct proc *curproc = myproc();
+  struct vma *v;
+  struct inode *ip;
+  pte_t *pte;
+  char *mem, *data;
+  uint pgno;
+  int perm;
+
+  va = PGROUNDDOWN(va);
+  if((v = vmafind(curproc, va, PGSIZE)) == 0)
+    return -1;
+  if((pte = walkpgdir(curproc->pgdir, (char*)va, 0)) != 0 && (*pte & PTE_P))
+    return -1;  // a store to a read-only page
+
+  ip = v->f->ip;
+  pgno = (va - v->start + v->off) / PGSIZE;
+  ilock(ip);
+  data = pget(ip, pgno);
+  iunlock(ip);
+  if(data == 0)
+    return -1;
+
+  perm = PTE_U;
+  if(v->prot & PROT_WRITE)
+    perm |= PTE_W;
+  if(v->flags == MAP_PRIVATE){
+    mem = kalloc();
+    if(mem)
+      memmove(mem, data, PGSIZE);
+    pput(ip, pgno);
+    if(mem == 0)
+      return -1;
+    data = mem;
+  } else
+    perm |= PTE_SHARED;
+  if(mappages(curproc->pgdir, (char*)va, PGSIZE, V2P(data), perm) < 0){
+    if(v->flags == MAP_PRIVATE)
+      kfree(data);
+    else
+      pput(ip, pgno);
+    return -1;
+  }
+  return 0;
+}
+
+// Map in any pages of [va, va+n) that are not yet, so that the
+// kernel can copy from them. Returns -1 if the range is not all
+// in one mapping.
+int
+vmaprefault(uint va, uint n)
+{
+  struct proc *curproc = myproc();
+  pte_t *pte;
+  uint a;
+
+  if(vmafind(curproc, va, n) == 0)
+    return -1;
+  for(a = PGROUNDDOWN(va); a < va + n; a += PGSIZE){
+    pte = walkpgdir(curproc->pgdir, (char*)a, 0);
+    if((pte == 0 || (*pte & PTE_P) == 0) && vmafault(a) < 0)
+      return -1;
+  }
+  return 0;
+}
+
+// Is [va, va+n) all within a mapping of the current process?
+int
+vmarange(uint va, uint n)
+{
+  return vmafind(myproc(), va, n) != 0;
+}
+
+// Write the shared page mapped at va back to the file, if the
+// process stored to it, never past the end of the file. This
+// only marks the page dirty; iflush() writes it to disk.
+static void
+writeback(struct vma *v, uint va, char *data)
+{
+  struct inode *ip = v->f->ip;
+  uint off, n;
+
+  off = va - v->start + v->off;
+  ilock(ip);
+  if(off < ip->size){
+    n = ip->size - off;
+    writei(ip, data, off, n < PGSIZE ? n : PGSIZE);
+  }
+  iunlock(ip);
+}
+
+// Unmap the pages of [start, end) of v from p.
+static void
+vmaunmap(struct proc *p, struct vma *v, uint start, uint end)
+{
+  pte_t *pte;
+  char *data;
+  uint va;
+
+  for(va = start; va < end; va += PGSIZE){
+    if((pte = walkpgdir(p->pgdir, (char*)va, 0)) == 0 || (*pte & PTE_P) == 0)
+      continue;
+    data = P2V(PTE_ADDR(*pte));
+    if(v->flags == MAP_PRIVATE)
+      kfree(data);
+    else {
+      if(*pte & PTE_D)
+        writeback(v, va, data);
+      pput(v->f->ip, (va - v->start + v->off) / PGSIZE);
+    }
+    *pte = 0;
+  }
+  if(p == myproc())
+    lcr3(V2P(p->pgdir));
+}
+
+// Unmap [addr, addr+len) of the current process, which must be
+// a whole mapping or its beginning or end.
+int
+munmap(uint addr, uint len)
+{
+  struct proc *curproc = myproc();
+  struct vma *v;
+
+  if(addr % PGSIZE || len == 0)
+    return -1;
+  len = PGROUNDUP(len);
+  if((v = vmafind(curproc, addr, len)) == 0)
+    return -1;
+  if(addr != v->start && addr + len != v->end)
+    return -1;
+
+  vmaunmap(curproc, v, addr, addr + len);
+  if(addr == v->start && addr + len == v->end){
+    fileclose(v->f);
+    v->start = 0;
+  } else if(addr == v->start){
+    v->start += len;
+    v->off += len;
+  } else
+    v->end = addr;
+  return 0;
+}
+
+// Unmap all of p's mappings, for exit() and exec().
+void
+vmafree(struct proc *p)
+{
+  struct vma *v;
+
+  for(v = p->vma; v < &p->vma[NVMA]; v++){
+    if(v->start){
+      vmaunmap(p, v, v->start, v->end);
+      fileclose(v->f);
+      v->start = 0;
+    }
+  }
+}
+
+// Give the new process np the mappings of the current one.
+// Shared pages are found again in the page cache when np
+// touches them; private ones are copied now.
+int
+vmafork(struct proc *np)
+{
+  struct proc *curproc = myproc();
+  struct vma *v, *nv;
+  pte_t *pte;
+  char *mem;
+  uint va;
+
+  for(v = curproc->vma; v < &curproc->vma[NVMA]; v++){
+    if(v->start == 0)
+      continue;
+    nv = &np->vma[v - curproc->vma];
+    *nv = *v;
+    nv->f = filedup(v->f);
+    if(v->flags != MAP_PRIVATE)
+      continue;
+    for(va = v->start; va < v->end; va += PGSIZE){
+      if((pte = walkpgdir(curproc->pgdir, (char*)va, 0)) == 0 || (*pte & PTE_P) == 0)
+        continue;
+      if((mem = kalloc()) == 0)
+        return -1;
+      memmove(mem, P2V(PTE_ADDR(*pte)), PGSIZE);
+      if(mappages(np->pgdir, (char*)va, PGSIZE, V2P(mem), PTE_FLAGS(*pte) & (PTE_U|PTE_W)) < 0){
+        kfree(mem);
+        return -1;
+      }
+    }
+  }
+  return 0;
+}
@@ -2,16 +2,45 @@
 #define KSTACKSIZE 4096  // size of per-process kernel stack
 #define NCPU          8  // maximum number of CPUs
 #define NOFILE       16  // open files per process
-#define NFILE       100  // open files per system
-#define NINODE       50  // maximum number of active i-nodes
+#define NINODE       50  // minimum number of cached i-nodes
 #define NDEV         10  // maximum major device number
 #define ROOTDEV       1  // device number of file system root disk
 #define MAXARG       32  // max exec arguments
 #define MAXOPBLOCKS  10  // max # of blocks any FS op writes
-#define LOGSIZE      (MAXOPBLOCKS*3)  // max data blocks in on-disk log
-#define NBUF         (MAXOPBLOCKS*3)  // size of disk block cache
-#define FSSIZE       1000  // size of file system in blocks
-#define NINODES      200   //number of inodes in inodes table
+#define LOGSIZE      120   // max data blocks in on-disk log (one header block)
+#define CKPTDELAY    100   // ticks committed transactions wait to be checkpointed
+#define WHEELHZ      1000  // timer interrupts per second (jiffies), a multiple of 100
+#define TICKDIV      10    // jiffies per clock tick
+#define NWHEEL       256   // timer wheel slots
+#define NBUF         (MAXOPBLOCKS*3)  // minimum size of disk block cache
+#define NBUFMAX      4096  // maximum size of disk block cache
+#define BCACHEFRAC   16    // disk block cache gets 1/BCACHEFRAC of free memory
+#define NBUCKET      509   // buffer cache hash buckets
+#define IDEDMA       1     // use bus-master DMA for the disk if found (0: PIO), unless booted with ide=pio
+#define FSSIZE       20000 // size of file system in blocks
+#define NINODES      6000  //number of inodes in inodes table
+#define MAXGROUPS    16    // max block groups in a file system
+#define NDENTRY      512   // name cache entries
+#define NDHASH       251   // name cache hash buckets
+#define NINODEMAX    1024  // maximum number of cached i-nodes
+#define ICACHEFRAC   256   // inode cache gets 1/ICACHEFRAC of free memory
+#define NIBUCKET     127   // inode cache hash buckets
+#define PIPEPAGES    4     // pages in a pipe's ring
+#define IOVMAX       64    // max buffers in one readv or writev
+#define NVMA         8     // mapped files per process
+#define NPHASH       509   // page cache hash buckets
+#define PCACHEFRAC   4     // page cache holds up to 1/PCACHEFRAC of free memory
+#define PCRAPAGES    4     // pages read at once by a sequential reader
+#define RAMIN        8     // first readahead window of a file, in blocks
+#define RAMAX        256   // largest readahead window, in blocks
+#define FLUSHDELAY   300   // ticks between write-backs of dirty file pages
+#define FLUSHBLOCKS  (MAXOPBLOCKS-6)  // file blocks written back per transaction
+#define MAXORDER     10    // largest buddy block is 2^MAXORDER pages
+#define KBATCH       32    // pages moved at once to or from a CPU's page cache
+#define KCACHEMAX    64    // most free pages a CPU keeps
+#ifndef KJUNK
+#define KJUNK        0     // fill freed pages with junk (build with -DKJUNK=1)
+#endif
 
 #define add_space    1
 #define no_space     0
\ No newline at end of file
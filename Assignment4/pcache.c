@@ -0,0 +1,331 @@
+// Page cache: the data of regular files in whole pages, found
+// by inode and page number. readi() copies file data out of
+// it, and mmap() maps its pages (see mmap.c). It is sized from
+// free memory, so a large file that is read again comes from
+// memory however small the block cache is.
+//
+// Pages are filled from disk by ireadpages(), which reads the
+// blocks through the block cache so that data still in the log
+// is seen. A reader that asks for the page after the one it
+// last got is taken to be sequential, and a miss then reads
+// PCRAPAGES pages at once, in one batch of disk requests.
+// writei() only copies file data into the pages and marks them
+// dirty; blocks are allocated and the data logged later, when
+// iflush() writes the pages back (see fs.c).
+//
+// A page with a nonzero ref is in use, by readi() or a mapping,
+// and stays put, as does a dirty page, whose data is nowhere
+// else. Other pages stay cached on an LRU list and are freed
+// when the cache has more than pcache.max pages.
+// All callers for one inode hold its lock, so two cannot fill
+// the same page at once.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "mmu.h"
+#include "spinlock.h"
+#include "sleeplock.h"
+#include "fs.h"
+#include "file.h"
+#include "slab.h"
+
+struct page {
+  uint dev;
+  uint inum;
+  uint pgno;            // page number within the file
+  int ref;              // readi() calls and mappings using it
+  int dirty;            // written, and not yet written back
+  char *data;
+  struct page *hnext;   // hash chain
+  struct page *prev;    // LRU list, when ref is 0 and not dirty
+  struct page *next;
+};
+
+struct {
+  struct spinlock lock;
+  struct kmem_cache cache;
+  struct page *hash[NPHASH];
+  struct page lru;      // lru.next is the most recently used
+  int npage;
+  int max;
+  int ndirty;
+  uint lookups;
+  uint hits;
+  uint readahead;       // pages read before they were asked for
+  uint evictions;
+  uint writebacks;      // dirty pages written back
+} pcache;
+
+// Must be called after kinit2() and slabinit().
+void
+pcinit(void)
+{
+  initlock(&pcache.lock, "pcache");
+  kmem_cache_init(&pcache.cache, "page", sizeof(struct page));
+  pcache.lru.next = &pcache.lru;
+  pcache.lru.prev = &pcache.lru;
+  pcache.max = kfreecount() / PCACHEFRAC;
+}
+
+static struct page**
+phash(uint dev, uint inum, uint pgno)
+{
+  return &pcache.hash[(dev*31 + inum*7919 + pgno) % NPHASH];
+}
+
+// Caller holds pcache.lock.
+static struct page*
+pfind(uint dev, uint inum, uint pgno)
+{
+  struct page *pg;
+
+  for(pg = *phash(dev, inum, pgno); pg; pg = pg->hnext)
+    if(pg->dev == dev && pg->inum == inum && pg->pgno == pgno)
+      return pg;
+  return 0;
+}
+
+// Is pg on the LRU list? Caller holds pcache.lock.
+static int
+pidle(struct page *pg)
+{
+  return pg->ref == 0 && !pg->dirty;
+}
+
+// Put pg at the front of the LRU list.
+static void
+lruput(struct page *pg)
+{
+  pg->next = pcache.lru.next;
+  pg->prev = &pcache.lru;
+  pg->next->prev = pg;
+  pcache.lru.next = pg;
+}
+
+static void
+lrudel(struct page *pg)
+{
+  pg->prev->next = pg->next;
+  pg->next->prev = pg->prev;
+}
+
+// Take pg off its hash chain and, if it is idle, the LRU list,
+// and free it. Caller holds pcache.lock.
+static void
+pfree(struct page *pg)
+{
+  struct page **pp;
+
+  for(pp = phash(pg->dev, pg->inum, pg->pgno); *pp != pg; pp = &(*pp)->hnext)
+    ;
+  *pp = pg->hnext;
+  if(pidle(pg))
+    lrudel(pg);
+  if(pg->dirty)
+    pcache.ndirty--;
+  pcache.npage--;
+  kfree(pg->data);
+  kmem_cache_free(&pcache.cache, pg);
+}
+
+// Put pg, just filled, in the cache, with reference ref.
+// Caller holds pcache.lock.
+static void
+pinsert(struct page *pg, int ref)
+{
+  struct page **hp;
+
+  hp = phash(pg->dev, pg->inum, pg->pgno);
+  pg->hnext = *hp;
+  *hp = pg;
+  pg->ref = ref;
+  pg->dirty = 0;
+  if(ref == 0)
+    lruput(pg);
+  pcache.npage++;
+}
+
+// Return the cached page pgno of ip, filling it from the file
+// if it is not cached, with a reference the caller gives back
+// with pput(). Bytes past the end of the file read as zero.
+// Returns 0 if out of memory. Caller must hold ip->lock.
+char*
+pget(struct inode *ip, uint pgno)
+{
+  struct page *pg, *fill[PCRAPAGES];
+  char *data[PCRAPAGES];
+  int i, n;
+
+  acquire(&pcache.lock);
+  pcache.lookups++;
+  if((pg = pfind(ip->dev, ip->inum, pgno)) != 0){
+    pcache.hits++;
+    if(pidle(pg))
+      lrudel(pg);
+    pg->ref++;
+    release(&pcache.lock);
+    ip->ranext = pgno + 1;
+    return pg->data;
+  }
+
+  // A sequential reader gets the pages after pgno too, up to
+  // the end of the file or the next page already cached.
+  n = 1;
+  if(pgno == ip->ranext && pgno > 0)
+    while(n < PCRAPAGES && (pgno+n)*PGSIZE < ip->size &&
+          pfind(ip->dev, ip->inum, pgno+n) == 0)
+      n++;
+  release(&pcache.lock);
+  ip->ranext = pgno + 1;
+
+  for(i = 0; i < n; i++){
+    if((data[i] = kalloc()) == 0)
+      break;
+    if((fill[i] = kmem_cache_alloc(&pcache.cache)) == 0){
+      kfree(data[i]);
+      break;
+    }
+    memset(data[i], 0, PGSIZE);
+    fill[i]->dev = ip->dev;
+    fill[i]->inum = ip->inum;
+    fill[i]->pgno = pgno + i;
+    fill[i]->data = data[i];
+  }
+  if((n = i) == 0)
+    return 0;
+  ireadpages(ip, pgno, n, data);
+
+  acquire(&pcache.lock);
+  for(i = 0; i < n; i++)
+    pinsert(fill[i], i == 0);
+  pcache.readahead += n - 1;
+  while(pcache.npage > pcache.max && pcache.lru.prev != &pcache.lru){
+    pfree(pcache.lru.prev);
+    pcache.evictions++;
+  }
+  release(&pcache.lock);
+  return data[0];
+}
+
+// Is page pgno of ip cached?
+int
+pcached(struct inode *ip, uint pgno)
+{
+  int r;
+
+  acquire(&pcache.lock);
+  r = pfind(ip->dev, ip->inum, pgno) != 0;
+  release(&pcache.lock);
+  return r;
+}
+
+// Give back a reference from pget().
+void
+pput(struct inode *ip, uint pgno)
+{
+  struct page *pg;
+
+  acquire(&pcache.lock);
+  if((pg = pfind(ip->dev, ip->inum, pgno)) == 0 || pg->ref < 1)
+    panic("pput");
+  pg->ref--;
+  if(pidle(pg))
+    lruput(pg);
+  release(&pcache.lock);
+}
+
+// Mark page pgno of ip, which the caller has from pget() and
+// has stored to, dirty. Caller must hold ip->lock.
+void
+pdirty(struct inode *ip, uint pgno)
+{
+  struct page *pg;
+
+  acquire(&pcache.lock);
+  if((pg = pfind(ip->dev, ip->inum, pgno)) == 0 || pg->ref < 1)
+    panic("pdirty");
+  if(!pg->dirty){
+    pg->dirty = 1;
+    pcache.ndirty++;
+  }
+  release(&pcache.lock);
+}
+
+// If page pgno of ip is dirty, mark it clean and return it with
+// a reference, for iflush() to write back; else return 0.
+// Caller must hold ip->lock.
+char*
+pclean(struct inode *ip, uint pgno)
+{
+  struct page *pg;
+
+  acquire(&pcache.lock);
+  if((pg = pfind(ip->dev, ip->inum, pgno)) == 0 || !pg->dirty){
+    release(&pcache.lock);
+    return 0;
+  }
+  pg->dirty = 0;
+  pg->ref++;
+  pcache.ndirty--;
+  pcache.writebacks++;
+  release(&pcache.lock);
+  return pg->data;
+}
+
+// Do dirty pages fill more than half the cache? Writers that
+// find so write their own back rather than wait for the flusher.
+int
+pdirtyfull(void)
+{
+  return pcache.ndirty > pcache.max / 2;
+}
+
+// Drop the cached pages of ip, whose data is being freed,
+// dirty or not. A mapping holds a reference to the inode, so
+// none of the pages can be in use. Caller must hold ip->lock.
+void
+pinval(struct inode *ip)
+{
+  struct page *pg, *next;
+  int i;
+
+  acquire(&pcache.lock);
+  for(i = 0; i < NPHASH; i++){
+    for(pg = pcache.hash[i]; pg; pg = next){
+      next = pg->hnext;
+      if(pg->dev == ip->dev && pg->inum == ip->inum){
+        if(pg->ref)
+          panic("pinval");
+        pfree(pg);
+      }
+    }
+  }
+  release(&pcache.lock);
+}
+
+int
+get_pcacheinfo_file_string(char* dst)
+{
+  int off = 0;
+
+  acquire(&pcache.lock);
+  char pages_str[] = "Cached pages: ";
+  off+=add_string_number(dst,off,pages_str,pcache.npage,add_space);
+  char max_str[] = "Max pages: ";
+  off+=add_string_number(dst,off,max_str,pcache.max,add_space);
+  char dirty_str[] = "Dirty pages: ";
+  off+=add_string_number(dst,off,dirty_str,pcache.ndirty,add_space);
+  char lookups_str[] = "Lookups: ";
+  off+=add_string_number(dst,off,lookups_str,pcache.lookups,add_space);
+  char hits_str[] = "Hits: ";
+  off+=add_string_number(dst,off,hits_str,pcache.hits,add_space);
+  char readahead_str[] = "Read ahead: ";
+  off+=add_string_number(dst,off,readahead_str,pcache.readahead,add_space);
+  char evictions_str[] = "Evictions: ";
+  off+=add_string_number(dst,off,evictions_str,pcache.evictions,add_space);
+  char writebacks_str[] = "Written back: ";
+  off+=add_string_number(dst,off,writebacks_str,pcache.writebacks,add_space);
+  release(&pcache.lock);
+  return off;
+}
@@ -7,18 +7,34 @@
 #include "spinlock.h"
 #include "sleeplock.h"
 #include "file.h"
+#include "slab.h"
 
-#define PIPESIZE 512
+// The ring is PIPEPAGES pages, allocated as they are first
+// written. Byte i of the stream is at i % PGSIZE of page
+// (i / PGSIZE) % PIPEPAGES. Readers and writers copy whole runs
+// with memmove, and a whole page-aligned page can move between
+// the ring and a user's address space without being copied at
+// all: vmsplice() moves the writer's pages in, and a read into a
+// page-aligned buffer maps ring pages in place of the reader's.
+#define PIPESIZE (PIPEPAGES*PGSIZE)
 
 struct pipe {
   struct spinlock lock;
-  char data[PIPESIZE];
+  char *page[PIPEPAGES];
   uint nread;     // number of bytes read
   uint nwrite;    // number of bytes written
   int readopen;   // read fd is still open
   int writeopen;  // write fd is still open
 };
 
+static struct kmem_cache pipecache;
+
+void
+pipeinit(void)
+{
+  kmem_cache_init(&pipecache, "pipe", sizeof(struct pipe));
+}
+
 int
 pipealloc(struct file **f0, struct file **f1)
 {
@@ -28,8 +44,9 @@ pipealloc(struct file **f0, struct file **f1)
   *f0 = *f1 = 0;
   if((*f0 = filealloc()) == 0 || (*f1 = filealloc()) == 0)
     goto bad;
-  if((p = (struct pipe*)kalloc()) == 0)
+  if((p = kmem_cache_alloc(&pipecache)) == 0)
     goto bad;
+  memset(p->page, 0, sizeof(p->page));
   p->readopen = 1;
   p->writeopen = 1;
   p->nwrite = 0;
@@ -48,7 +65,7 @@ pipealloc(struct file **f0, struct file **f1)
 //PAGEBREAK: 20
  bad:
   if(p)
-    kfree((char*)p);
+    kmem_cache_free(&pipecache, p);
   if(*f0)
     fileclose(*f0);
   if(*f1)
@@ -59,6 +76,8 @@ pipealloc(struct file **f0, struct file **f1)
 void
 pipeclose(struct pipe *p, int writable)
 {
+  int i;
+
   acquire(&p->lock);
   if(writable){
     p->writeopen = 0;
@@ -69,19 +88,27 @@ pipeclose(struct pipe *p, int writable)
   }
   if(p->readopen == 0 && p->writeopen == 0){
     release(&p->lock);
-    kfree((char*)p);
+    for(i = 0; i < PIPEPAGES; i++)
+      if(p->page[i])
+        kfree(p->page[i]);
+    kmem_cache_free(&pipecache, p);
   } else
     release(&p->lock);
 }
 
 //PAGEBREAK: 40
+// Write n bytes from addr. If move is set, whole pages of addr
+// that are page-aligned are moved into the ring instead of
+// copied, and replaced by zeroed pages.
 int
-pipewrite(struct pipe *p, char *addr, int n)
+pipewrite(struct pipe *p, char *addr, int n, int move)
 {
+  char **pg, *mem, *old;
+  uint m, off;
   int i;
 
   acquire(&p->lock);
-  for(i = 0; i < n; i++){
+  for(i = 0; i < n; ){
     while(p->nwrite == p->nread + PIPESIZE){  //DOC: pipewrite-full
       if(p->readopen == 0 || myproc()->killed){
         release(&p->lock);
@@ -90,30 +117,81 @@ pipewrite(struct pipe *p, char *addr, int n)
       wakeup(&p->nread);
       sleep(&p->nwrite, &p->lock);  //DOC: pipewrite-sleep
     }
-    p->data[p->nwrite++ % PIPESIZE] = addr[i];
+    pg = &p->page[(p->nwrite / PGSIZE) % PIPEPAGES];
+    off = p->nwrite % PGSIZE;
+    m = p->nread + PIPESIZE - p->nwrite;
+    if(m > PGSIZE - off)
+      m = PGSIZE - off;
+    if(m > n - i)
+      m = n - i;
+
+    if(move && off == 0 && m == PGSIZE && (uint)(addr+i) % PGSIZE == 0 &&
+       (mem = kalloc()) != 0){
+      memset(mem, 0, PGSIZE);
+      if((old = uswappage(myproc()->pgdir, addr+i, mem)) != 0){
+        if(*pg)
+          kfree(*pg);
+        *pg = old;
+        p->nwrite += PGSIZE;
+        i += PGSIZE;
+        continue;
+      }
+      kfree(mem);
+    }
+
+    if(*pg == 0 && (*pg = kalloc()) == 0){
+      release(&p->lock);
+      return -1;
+    }
+    if(ucopyin(*pg + off, addr + i, m) < 0){
+      release(&p->lock);
+      return -1;
+    }
+    p->nwrite += m;
+    i += m;
   }
   wakeup(&p->nread);  //DOC: pipewrite-wakeup1
   release(&p->lock);
   return n;
 }
 
+// Read up to n bytes into addr. If wait is clear, return 0
+// rather than sleep when the pipe is empty.
 int
-piperead(struct pipe *p, char *addr, int n)
+piperead(struct pipe *p, char *addr, int n, int wait)
 {
+  char **pg, *old;
+  uint m, off;
   int i;
 
   acquire(&p->lock);
-  while(p->nread == p->nwrite && p->writeopen){  //DOC: pipe-empty
+  while(p->nread == p->nwrite && p->writeopen && wait){  //DOC: pipe-empty
     if(myproc()->killed){
       release(&p->lock);
       return -1;
     }
     sleep(&p->nread, &p->lock); //DOC: piperead-sleep
   }
-  for(i = 0; i < n; i++){  //DOC: piperead-copy
-    if(p->nread == p->nwrite)
-      break;
-    addr[i] = p->data[p->nread++ % PIPESIZE];
+  for(i = 0; i < n && p->nread != p->nwrite; ){  //DOC: piperead-copy
+    pg = &p->page[(p->nread / PGSIZE) % PIPEPAGES];
+    off = p->nread % PGSIZE;
+    m = p->nwrite - p->nread;
+    if(m > PGSIZE - off)
+      m = PGSIZE - off;
+    if(m > n - i)
+      m = n - i;
+
+    // A whole page for a page-aligned buffer: map it there.
+    if(off == 0 && m == PGSIZE && (uint)(addr+i) % PGSIZE == 0 &&
+       (old = uswappage(myproc()->pgdir, addr+i, *pg)) != 0){
+      kfree(old);
+      *pg = 0;
+    } else if(ucopyout(addr + i, *pg + off, m) < 0){
+      release(&p->lock);
+      return -1;
+    }
+    p->nread += m;
+    i += m;
   }
   wakeup(&p->nwrite);  //DOC: piperead-wakeup
   release(&p->lock);
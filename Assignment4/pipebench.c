@@ -0,0 +1,120 @@
+// Pipe benchmark: a child writes TOTAL bytes into a pipe that
+// the parent reads, first in 512-byte writes, then in page-sized
+// writes from and reads into page-aligned buffers, and last with
+// vmsplice() so whole pages move through the pipe without being
+// copied. Reports the ticks each pass takes. The first and the
+// last write of each pass carry a pattern the parent checks.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+
+#define TOTAL (8*1024*1024)
+#define PGSIZE 4096
+#define CHUNK (4*PGSIZE)
+
+char *wbuf, *rbuf;
+
+// The byte at offset off of the stream, in the checked writes.
+char
+pattern(uint off)
+{
+  return off + off / PGSIZE;
+}
+
+// Fill the n bytes of wbuf to be written at offset off. A
+// vmsplice() takes the pages away, so this is done again before
+// each checked write.
+void
+fill(uint off, int n)
+{
+  int i;
+
+  for(i = 0; i < n; i++)
+    wbuf[i] = pattern(off + i);
+}
+
+// Check the m bytes just read at offset off against the pattern,
+// where they fall in the first or the last write of n bytes.
+// Returns 0 if they match.
+int
+check(uint off, int m, int n)
+{
+  int i;
+
+  for(i = 0; i < m; i++){
+    if(off + i >= n && off + i < TOTAL - n)
+      continue;
+    if(rbuf[i] != pattern(off + i)){
+      printf(1, "pipebench: byte %d of %d is wrong\n", off + i, TOTAL);
+      return -1;
+    }
+  }
+  return 0;
+}
+
+// Send TOTAL bytes through a pipe in writes of n bytes, moving
+// pages if splice is set, and return the ticks taken.
+int
+run(int n, int splice)
+{
+  int fd[2], pid, start, got, m, bad;
+
+  if(pipe(fd) < 0){
+    printf(1, "pipebench: pipe failed\n");
+    exit();
+  }
+  start = uptime();
+  if((pid = fork()) < 0){
+    printf(1, "pipebench: fork failed\n");
+    exit();
+  }
+  if(pid == 0){
+    close(fd[0]);
+    for(got = 0; got < TOTAL; got += n){
+      if(got == 0 || got + n == TOTAL)
+        fill(got, n);
+      m = splice ? vmsplice(fd[1], wbuf, n) : write(fd[1], wbuf, n);
+      if(m != n){
+        printf(1, "pipebench: write failed\n");
+        exit();
+      }
+    }
+    close(fd[1]);
+    exit();
+  }
+  close(fd[1]);
+  got = 0;
+  bad = 0;
+  while((m = read(fd[0], rbuf, n > CHUNK ? CHUNK : n)) > 0){
+    if(!bad && (got < n || got + m > TOTAL - n))
+      bad = check(got, m, n);
+    got += m;
+  }
+  close(fd[0]);
+  wait();
+  if(got != TOTAL)
+    printf(1, "pipebench: read %d bytes, expected %d\n", got, TOTAL);
+  return uptime() - start;
+}
+
+int
+main(int argc, char *argv[])
+{
+  char *p;
+  int t;
+
+  // Page-aligned buffers, so whole pages can move.
+  p = sbrk(0);
+  sbrk(PGSIZE - (uint)p % PGSIZE + 2*CHUNK);
+  wbuf = (char*)(((uint)p + PGSIZE - 1) / PGSIZE * PGSIZE);
+  rbuf = wbuf + CHUNK;
+
+  t = run(512, 0);
+  printf(1, "pipebench: %d KB in 512-byte writes: %d ticks\n", TOTAL/1024, t);
+  t = run(PGSIZE, 0);
+  printf(1, "pipebench: %d KB in page writes: %d ticks\n", TOTAL/1024, t);
+  t = run(CHUNK, 1);
+  printf(1, "pipebench: %d KB moved with vmsplice: %d ticks\n", TOTAL/1024, t);
+  exit();
+}
@@ -161,6 +161,28 @@ userinit(void)
   release(&ptable.lock);
 }
 
+// Start a kernel thread that runs fn() under the given name.
+// It has no user memory, never returns to user space and
+// must never return from fn.
+void
+kproc(char *name, void (*fn)(void))
+{
+  struct proc *p;
+
+  if((p = allocproc()) == 0)
+    panic("kproc");
+  if((p->pgdir = setupkvm()) == 0)
+    panic("kproc: out of memory?");
+  // forkret() returns into fn instead of trapret.
+  *(uint*)((char*)p->tf - 4) = (uint)fn;
+  p->parent = initproc;
+  safestrcpy(p->name, name, sizeof(p->name));
+
+  acquire(&ptable.lock);
+  p->state = RUNNABLE;
+  release(&ptable.lock);
+}
+
 // Grow current process's memory by n bytes.
 // Return 0 on success, -1 on failure.
 int
@@ -171,6 +193,8 @@ growproc(int n)
 
   sz = curproc->sz;
   if(n > 0){
+    if(sz + n > MMAPBASE)
+      return -1;
     if((sz = allocuvm(curproc->pgdir, sz, sz + n)) == 0)
       return -1;
   } else if(n < 0){
@@ -205,6 +229,14 @@ fork(void)
     return -1;
   }
   np->sz = curproc->sz;
+  if(vmafork(np) < 0){
+    vmafree(np);
+    freevm(np->pgdir);
+    kfree(np->kstack);
+    np->kstack = 0;
+    np->state = UNUSED;
+    return -1;
+  }
   np->parent = curproc;
   *np->tf = *curproc->tf;
 
@@ -242,6 +274,8 @@ exit(void)
   if(curproc == initproc)
     panic("init exiting");
 
+  vmafree(curproc);
+
   // Close all open files.
   for(fd = 0; fd < NOFILE; fd++){
     if(curproc->ofile[fd]){
@@ -8,6 +8,7 @@ struct cpu {
   int ncli;                    // Depth of pushcli nesting.
   int intena;                  // Were interrupts enabled before pushcli?
   struct proc *proc;           // The process running on this cpu or null
+  uint jiffies;                // Timer interrupts on this cpu
 };
 
 extern struct cpu cpus[NCPU];
@@ -33,6 +34,16 @@ struct context {
 };
 enum file_identifier { UNINTIALIZED ,IDEINFO, FILESTAT,  INODEINFO_DIR, INODEINFO_FILE, PROC_DIR, PROC_NAME, PROC_STATUS, PROCFS_DIR };
 
+// A file mapped into memory; see mmap.c.
+struct vma {
+  uint start;         // first address; 0 if the slot is unused
+  uint end;
+  int prot;           // PROT_READ and PROT_WRITE
+  int flags;          // MAP_SHARED or MAP_PRIVATE
+  struct file *f;
+  uint off;           // file offset of start
+};
+
 enum procstate { UNUSED, EMBRYO, SLEEPING, RUNNABLE, RUNNING, ZOMBIE };
 
 // Per-process state
@@ -50,6 +61,7 @@ struct proc {
   struct file *ofile[NOFILE];  // Open files
   struct inode *cwd;           // Current directory
   char name[16];               // Process name (debugging)
+  struct vma vma[NVMA];        // Mapped files
 };
 
 // Process memory is laid out contiguously, low addresses first:
@@ -13,13 +13,23 @@
 #include "x86.h"
 
 
-#define INUM_START 202
-#define FILESTAT_INUM  203
-#define INODEINFO_INUM 204
-#define INODE_INFO_FILES_INUM_START 205
-
-#define INODE_INFO_FILES_INUM_LIMIT 405
-#define PROC_INUM_START 406
+// procfs inums start past the last inode on disk
+#define INUM_START (NINODES+2)
+#define FILESTAT_INUM  (INUM_START+1)
+#define INODEINFO_INUM (INUM_START+2)
+#define INODE_INFO_FILES_INUM_START (INUM_START+3)
+
+#define INODE_INFO_FILES_INUM_LIMIT (INODE_INFO_FILES_INUM_START+NINODEMAX)
+#define PROC_INUM_START (INODE_INFO_FILES_INUM_LIMIT+1)
+#define PROC_INUM_LIMIT (PROC_INUM_START + NPROC*3)
+#define BCACHEINFO_INUM PROC_INUM_LIMIT
+#define LOGINFO_INUM    (PROC_INUM_LIMIT+1)
+#define FSINFO_INUM     (PROC_INUM_LIMIT+2)
+#define DCACHEINFO_INUM (PROC_INUM_LIMIT+3)
+#define ICACHEINFO_INUM (PROC_INUM_LIMIT+4)
+#define MEMINFO_INUM    (PROC_INUM_LIMIT+5)
+#define SLABINFO_INUM   (PROC_INUM_LIMIT+6)
+#define PCACHEINFO_INUM (PROC_INUM_LIMIT+7)
 
 int proc_dir_inum = -1;
 
@@ -28,7 +38,7 @@ procfsisdir(struct inode *ip) {
   int is_inodeinfo_dir = ((ip->inum == INODEINFO_INUM) && (ip->type == T_DEV))? 1:0;
   int j = ip->inum-PROC_INUM_START;
 
-  int is_process_dir = (((j>=0) && (j%3 == 0)) && (ip->type == T_DEV))? 1:0;
+  int is_process_dir = (((j>=0) && (j<NPROC*3) && (j%3 == 0)) && (ip->type == T_DEV))? 1:0;
   if(is_inodeinfo_dir){
     // cprintf("procfsisdir: is_inodeinfo_dir\n");
     return 1;
@@ -37,7 +47,7 @@ procfsisdir(struct inode *ip) {
     // cprintf("procfsisdir: is_process_dir j: %d\n",j);
     return 1;
   }
-  if((ip->inum <NINODE) && (ip->type == T_DEV)){
+  if((ip->inum <NINODES) && (ip->type == T_DEV)){
     proc_dir_inum = ip->inum;
     // cprintf("procfsisdir: is_proc_dir inum:%d\n",ip->inum);
     return 1;
@@ -124,6 +134,54 @@ get_proc_directory_string(char* dst, int current_dir_inum){
   inum = INUM_START+2;
   add_dirent(dst, off,inum,inodeinfo_name);
   off+=sizeof(struct dirent);
+
+  // for bcacheinfo file
+  char bcacheinfo_name[] = "bcacheinfo";
+  inum = BCACHEINFO_INUM;
+  add_dirent(dst, off,inum,bcacheinfo_name);
+  off+=sizeof(struct dirent);
+
+  // for loginfo file
+  char loginfo_name[] = "loginfo";
+  inum = LOGINFO_INUM;
+  add_dirent(dst, off,inum,loginfo_name);
+  off+=sizeof(struct dirent);
+
+  // for fsinfo file
+  char fsinfo_name[] = "fsinfo";
+  inum = FSINFO_INUM;
+  add_dirent(dst, off,inum,fsinfo_name);
+  off+=sizeof(struct dirent);
+
+  // for dcacheinfo file
+  char dcacheinfo_name[] = "dcacheinfo";
+  inum = DCACHEINFO_INUM;
+  add_dirent(dst, off,inum,dcacheinfo_name);
+  off+=sizeof(struct dirent);
+
+  // for icacheinfo file
+  char icacheinfo_name[] = "icacheinfo";
+  inum = ICACHEINFO_INUM;
+  add_dirent(dst, off,inum,icacheinfo_name);
+  off+=sizeof(struct dirent);
+
+  // for meminfo file
+  char meminfo_name[] = "meminfo";
+  inum = MEMINFO_INUM;
+  add_dirent(dst, off,inum,meminfo_name);
+  off+=sizeof(struct dirent);
+
+  // for slabinfo file
+  char slabinfo_name[] = "slabinfo";
+  inum = SLABINFO_INUM;
+  add_dirent(dst, off,inum,slabinfo_name);
+  off+=sizeof(struct dirent);
+
+  // for pcacheinfo file
+  char pcacheinfo_name[] = "pcacheinfo";
+  inum = PCACHEINFO_INUM;
+  add_dirent(dst, off,inum,pcacheinfo_name);
+  off+=sizeof(struct dirent);
   // cprintf("before calc process off %d\n", off);
   int num_process =0;
 
@@ -180,29 +238,40 @@ get_process_directory_string(char* dst, int current_dir_inum){
 }
 
 
+// The inodeinfo directory can list up to NINODEMAX+2 dirents,
+// more than the page holds, so the page is built starting at
+// dirent first of the listing.
 int
-get_inodeinfo_directory_string(char* dst, int current_dir_inum){
+get_inodeinfo_directory_string(char* dst, int current_dir_inum, int first){
   int off = 0;  
   int index_in_inodes_table = 0;
   struct inode *inode_table_ip;
   int inum = 0;
+  int entry = 0;
 
   // for .
   char current_dir_name[] = ".";
   inum = current_dir_inum;
-  add_dirent(dst, off,inum,current_dir_name);
-  off+=sizeof(struct dirent); 
+  if(entry++ >= first){
+    add_dirent(dst, off,inum,current_dir_name);
+    off+=sizeof(struct dirent); 
+  }
 
   // for ..
   char parent_dir_name[] = "..";
   inum = proc_dir_inum;
-  add_dirent(dst, off,inum,parent_dir_name);
-  off+=sizeof(struct dirent);
+  if(entry++ >= first){
+    add_dirent(dst, off,inum,parent_dir_name);
+    off+=sizeof(struct dirent);
+  }
 
   int in_inodeinfo_directory = 1;
 
-  for(index_in_inodes_table=0;index_in_inodes_table<NINODE;index_in_inodes_table++){
+  // list the cache entries in use, as many as fit in the page
+  for(index_in_inodes_table=0;index_in_inodes_table<NINODEMAX && off+sizeof(struct dirent)<=PGSIZE;index_in_inodes_table++){
     if((inode_table_ip = get_ip_from_icache_index(index_in_inodes_table,in_inodeinfo_directory))!= 0){     
+      if(entry++ < first)
+        continue;
       char inode_index_str[256];
       memset(inode_index_str,0,256);
       itoa(index_in_inodes_table,inode_index_str);
@@ -217,14 +286,14 @@ get_inodeinfo_directory_string(char* dst, int current_dir_inum){
 }
 
 int
-get_directory_string(char *dst, int inum) {  
+get_directory_string(char *dst, int inum, int first) {  
   if (inum == proc_dir_inum){  
       // main directory 
       return get_proc_directory_string(dst, inum);  
   }
   if(inum == INODEINFO_INUM){
     // inodeinfo directory
-      return get_inodeinfo_directory_string(dst, inum);
+      return get_inodeinfo_directory_string(dst, inum, first);
   }   
   // for process directory
   return get_process_directory_string(dst, inum);  
@@ -234,23 +303,30 @@ int
 handle_directory(struct inode *ip, char *dst, int off, int n) {  
 
   int string_off = 0;  
-  // process+first files + currentdir_parentdir =  NPROC+3+2
-  // for NINODE inodes and parentdir and current dir = NINODE+2
-  int num_of_dirents_in_inodeinfo_directory = NINODE+2;
-  // for name and status and parentdir and current dir = 2+2
-  int num_of_dirents_in_directory_string = num_of_dirents_in_inodeinfo_directory;
-  int size_for_directory_string = num_of_dirents_in_directory_string*sizeof(struct dirent);
-  char directory_string[size_for_directory_string]; 
-  memset(directory_string, 0,strlen(directory_string));
-
-  string_off = get_directory_string(directory_string, ip->inum);
+  int first = 0;
+  // the dirents are built in a page, which is too big for the
+  // kernel stack and holds PGSIZE/sizeof(struct dirent) of them
+  char *directory_string;
+  if((directory_string = kalloc()) == 0)
+    return -1;
+  memset(directory_string, 0, PGSIZE);
+
+  if(ip->inum == INODEINFO_INUM){
+    // build the page from the dirent at off on
+    first = off / sizeof(struct dirent);
+    off %= sizeof(struct dirent);
+  }
+  string_off = get_directory_string(directory_string, ip->inum, first);
 
   if(off>string_off){
+    kfree(directory_string);
     return 0;
   }
 
   char* full_dir = directory_string+off;     
+  n = (PGSIZE-off<n)?PGSIZE-off:n;
   memmove(dst,full_dir,n);      
+  kfree(directory_string);
   return n;  
 }
 
@@ -355,6 +431,38 @@ get_file_string(char *dst, int inum) {
       // cprintf("get_file_string inodeinfo files\n");
       return get_inodeinfo_file_string(dst, inum);
   }  
+  if(inum == BCACHEINFO_INUM){
+    // bcacheinfo file
+      return get_bcacheinfo_file_string(dst);
+  }
+  if(inum == LOGINFO_INUM){
+    // loginfo file
+      return get_loginfo_file_string(dst);
+  }
+  if(inum == FSINFO_INUM){
+    // fsinfo file
+      return get_fsinfo_file_string(dst);
+  }
+  if(inum == DCACHEINFO_INUM){
+    // dcacheinfo file
+      return get_dcacheinfo_file_string(dst);
+  }
+  if(inum == ICACHEINFO_INUM){
+    // icacheinfo file
+      return get_icacheinfo_file_string(dst);
+  }
+  if(inum == MEMINFO_INUM){
+    // meminfo file
+      return get_meminfo_file_string(dst);
+  }
+  if(inum == SLABINFO_INUM){
+    // slabinfo file
+      return get_slabinfo_file_string(dst);
+  }
+  if(inum == PCACHEINFO_INUM){
+    // pcacheinfo file
+      return get_pcacheinfo_file_string(dst);
+  }
   // for process files
   if(inum%3 == 2){
     return get_name_file_string(dst, inum);
@@ -366,15 +474,18 @@ get_file_string(char *dst, int inum) {
 int
 read_from_file(struct inode *ip, char *dst, int off, int n){  
   int string_off = 0;   
-  char file_string[PGSIZE]; 
-  memset(file_string, 0,strlen(file_string));
+  char *file_string;
+  if((file_string = kalloc()) == 0)
+    return -1;
+  memset(file_string, 0, PGSIZE);
   string_off = get_file_string(file_string, ip->inum);
-  char* full_dir = file_string+off;     
-  memmove(dst,full_dir,n);     
   if(off>string_off){
+    kfree(file_string);
     return 0;
   }  
   n = (string_off-off<n)?string_off-off:n;   
+  memmove(dst,file_string+off,n);     
+  kfree(file_string);
   return n;  
 }
 
@@ -0,0 +1,226 @@
+// Slab allocator for small kernel objects.
+//
+// A kmem_cache hands out objects of one size. The objects are
+// carved out of slabs: pages from kalloc() that start with a
+// struct slab and hold perslab objects after it, the free ones
+// linked through their first word. Slabs with free objects are
+// on the cache's partial list; a full slab is on no list, and
+// an empty one goes back to kfree() unless it is the only slab
+// with free objects left.
+//
+// In front of the slabs each CPU has a magazine of up to
+// MAGSIZE free objects. kmem_cache_alloc() and kmem_cache_free()
+// only use the magazine of the CPU they run on, with interrupts
+// off, and take the cache's lock only to move half a magazine
+// of objects to or from the slabs.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "mmu.h"
+#include "spinlock.h"
+#include "slab.h"
+
+struct slab {
+  struct kmem_cache *cache;
+  struct slab *next;  // partial list
+  struct slab *prev;
+  void *free;         // free objects, through their first word
+  uint inuse;
+};
+
+// First object of a slab, after the header.
+#define SLABOBJS(s) ((char*)(s) + ((sizeof(struct slab) + 7) & ~7))
+
+struct {
+  struct spinlock lock;
+  struct kmem_cache *caches;
+} slabs;
+
+void
+slabinit(void)
+{
+  initlock(&slabs.lock, "slabs");
+}
+
+// Set up cache c for objects of size bytes.
+void
+kmem_cache_init(struct kmem_cache *c, char *name, uint size)
+{
+  memset(c, 0, sizeof(*c));
+  initlock(&c->lock, name);
+  c->name = name;
+  c->size = (size + 7) & ~7;
+  if(c->size < sizeof(void*))
+    c->size = sizeof(void*);
+  c->perslab = (PGSIZE - (SLABOBJS(0) - (char*)0)) / c->size;
+  if(c->perslab == 0)
+    panic("kmem_cache_init: object too big");
+
+  acquire(&slabs.lock);
+  c->next = slabs.caches;
+  slabs.caches = c;
+  release(&slabs.lock);
+}
+
+// Remove s from the partial list of c.
+static void
+slabunlink(struct kmem_cache *c, struct slab *s)
+{
+  if(s->prev)
+    s->prev->next = s->next;
+  else
+    c->partial = s->next;
+  if(s->next)
+    s->next->prev = s->prev;
+}
+
+// Put s on the partial list of c.
+static void
+slabpush(struct kmem_cache *c, struct slab *s)
+{
+  s->prev = 0;
+  s->next = c->partial;
+  if(c->partial)
+    c->partial->prev = s;
+  c->partial = s;
+}
+
+// Take a free object from the slabs of c, adding a slab if
+// there is none. Caller holds c->lock.
+static void*
+slaballoc(struct kmem_cache *c)
+{
+  struct slab *s;
+  char *obj;
+  uint i;
+
+  if((s = c->partial) == 0){
+    if((s = (struct slab*)kalloc()) == 0)
+      return 0;
+    s->cache = c;
+    s->free = 0;
+    s->inuse = 0;
+    for(i = c->perslab; i > 0; i--){
+      obj = SLABOBJS(s) + (i - 1) * c->size;
+      *(void**)obj = s->free;
+      s->free = obj;
+    }
+    slabpush(c, s);
+    c->nslab++;
+  }
+  obj = s->free;
+  s->free = *(void**)obj;
+  s->inuse++;
+  c->inuse++;
+  if(s->free == 0)
+    slabunlink(c, s);
+  return obj;
+}
+
+// Return obj to its slab. Caller holds c->lock.
+static void
+slabfree(struct kmem_cache *c, void *obj)
+{
+  struct slab *s;
+
+  s = (struct slab*)PGROUNDDOWN((uint)obj);
+  if(s->cache != c)
+    panic("slabfree");
+  if(s->free == 0)
+    slabpush(c, s);
+  *(void**)obj = s->free;
+  s->free = obj;
+  s->inuse--;
+  c->inuse--;
+  if(s->inuse == 0 && (s->next || s->prev)){
+    slabunlink(c, s);
+    c->nslab--;
+    kfree((char*)s);
+  }
+}
+
+// Allocate an object from cache c.
+// Returns 0 if the memory cannot be allocated.
+void*
+kmem_cache_alloc(struct kmem_cache *c)
+{
+  struct magazine *m;
+  void *obj;
+
+  pushcli();
+  m = &c->mag[cpuid()];
+  if(m->n == 0){
+    acquire(&c->lock);
+    while(m->n < MAGSIZE/2 && (obj = slaballoc(c)) != 0)
+      m->obj[m->n++] = obj;
+    c->refills++;
+    release(&c->lock);
+  }
+  obj = m->n > 0 ? m->obj[--m->n] : 0;
+  popcli();
+  return obj;
+}
+
+// Free an object allocated from cache c.
+void
+kmem_cache_free(struct kmem_cache *c, void *obj)
+{
+  struct magazine *m;
+
+  pushcli();
+  m = &c->mag[cpuid()];
+  if(m->n == MAGSIZE){
+    acquire(&c->lock);
+    while(m->n > MAGSIZE/2)
+      slabfree(c, m->obj[--m->n]);
+    c->drains++;
+    release(&c->lock);
+  }
+  m->obj[m->n++] = obj;
+  popcli();
+}
+
+// Objects of cache c that are free, in magazines or slabs.
+int
+kmem_cache_nfree(struct kmem_cache *c)
+{
+  int i, n;
+
+  acquire(&c->lock);
+  n = c->nslab * c->perslab - c->inuse;
+  for(i = 0; i < NCPU; i++)
+    n += c->mag[i].n;
+  release(&c->lock);
+  return n;
+}
+
+int
+get_slabinfo_file_string(char* dst)
+{
+  struct kmem_cache *c;
+  int off = 0;
+  int i, inuse;
+
+  acquire(&slabs.lock);
+  for(c = slabs.caches; c; c = c->next){
+    acquire(&c->lock);
+    inuse = c->inuse;
+    for(i = 0; i < NCPU; i++)
+      inuse -= c->mag[i].n;
+    off+=add_string_number(dst,off,c->name,-1,no_space);
+    char size_str[] = ": size ";
+    off+=add_string_number(dst,off,size_str,c->size,no_space);
+    char inuse_str[] = ", in use ";
+    off+=add_string_number(dst,off,inuse_str,inuse,no_space);
+    char slabs_str[] = ", slabs ";
+    off+=add_string_number(dst,off,slabs_str,c->nslab,no_space);
+    char refills_str[] = ", refills ";
+    off+=add_string_number(dst,off,refills_str,c->refills,no_space);
+    char drains_str[] = ", drains ";
+    off+=add_string_number(dst,off,drains_str,c->drains,add_space);
+    release(&c->lock);
+  }
+  release(&slabs.lock);
+  return off;
+}
@@ -0,0 +1,23 @@
+// Cache of equal-sized kernel objects; see slab.c.
+// Users need spinlock.h and param.h.
+
+#define MAGSIZE 16   // objects in a per-CPU magazine
+
+struct magazine {
+  int n;
+  void *obj[MAGSIZE];
+};
+
+struct kmem_cache {
+  struct spinlock lock;  // protects the slabs and counters
+  char *name;
+  uint size;             // object size
+  uint perslab;          // objects per slab
+  struct slab *partial;  // slabs with free objects
+  int nslab;
+  int inuse;             // objects handed out of the slabs
+  uint refills;
+  uint drains;
+  struct magazine mag[NCPU];
+  struct kmem_cache *next;  // on the list of all caches
+};
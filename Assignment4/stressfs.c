@@ -16,17 +16,19 @@
 int
 main(int argc, char *argv[])
 {
-  int fd, i;
+  int fd, i, me, start;
   char path[] = "stressfs0";
   char data[512];
 
   printf(1, "stressfs starting\n");
   memset(data, 'a', sizeof(data));
+  start = uptime();
 
   for(i = 0; i < 4; i++)
     if(fork() > 0)
       break;
 
+  me = i;
   printf(1, "write %d\n", i);
 
   path[8] += i;
@@ -45,5 +47,7 @@ main(int argc, char *argv[])
 
   wait();
 
+  if(me == 0)
+    printf(1, "stressfs done in %d ticks\n", uptime() - start);
   exit();
 }
@@ -41,9 +41,10 @@ memmove(void *dst, const void *src, uint n)
     d += n;
     while(n-- > 0)
       *--d = *--s;
-  } else
-    while(n-- > 0)
-      *d++ = *s++;
+  } else if(((uint)s | (uint)d | n) % 4 == 0)
+    movsl(d, s, n/4);
+  else
+    movsb(d, s, n);
 
   return dst;
 }
@@ -69,6 +69,24 @@ argptr(int n, char **pp, int size)
   return 0;
 }
 
+// Like argptr, but the block may also lie in a mapped file, for
+// buffers the kernel only reads, such as write()'s. Its pages
+// are mapped in now, so copying from them cannot fault.
+// (A block the kernel stores to must come from argptr: a mapping
+// may be read-only.)
+int
+argbuf(int n, char **pp, int size)
+{
+  int i;
+
+  if(argptr(n, pp, size) == 0)
+    return 0;
+  if(size < 0 || argint(n, &i) < 0 || vmaprefault(i, size) < 0)
+    return -1;
+  *pp = (char*)i;
+  return 0;
+}
+
 // Fetch the nth word-sized system call argument as a string pointer.
 // Check that the pointer is valid and the string is nul-terminated.
 // (There is no shared writable memory, so the string can't change
@@ -103,6 +121,16 @@ extern int sys_unlink(void);
 extern int sys_wait(void);
 extern int sys_write(void);
 extern int sys_uptime(void);
+extern int sys_vmsplice(void);
+extern int sys_readv(void);
+extern int sys_writev(void);
+extern int sys_pread(void);
+extern int sys_pwrite(void);
+extern int sys_mmap(void);
+extern int sys_munmap(void);
+extern int sys_fsync(void);
+extern int sys_clocktime(void);
+extern int sys_nanosleep(void);
 
 static int (*syscalls[])(void) = {
 [SYS_fork]    sys_fork,
@@ -126,6 +154,16 @@ static int (*syscalls[])(void) = {
 [SYS_link]    sys_link,
 [SYS_mkdir]   sys_mkdir,
 [SYS_close]   sys_close,
+[SYS_vmsplice] sys_vmsplice,
+[SYS_readv]   sys_readv,
+[SYS_writev]  sys_writev,
+[SYS_pread]   sys_pread,
+[SYS_pwrite]  sys_pwrite,
+[SYS_mmap]    sys_mmap,
+[SYS_munmap]  sys_munmap,
+[SYS_fsync]   sys_fsync,
+[SYS_clocktime] sys_clocktime,
+[SYS_nanosleep] sys_nanosleep,
 };
 
 void
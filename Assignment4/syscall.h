@@ -20,3 +20,13 @@
 #define SYS_link   19
 #define SYS_mkdir  20
 #define SYS_close  21
+#define SYS_vmsplice 22
+#define SYS_readv  23
+#define SYS_writev 24
+#define SYS_pread  25
+#define SYS_pwrite 26
+#define SYS_mmap   27
+#define SYS_munmap 28
+#define SYS_fsync  29
+#define SYS_clocktime 30
+#define SYS_nanosleep 31
@@ -15,6 +15,7 @@
 #include "sleeplock.h"
 #include "file.h"
 #include "fcntl.h"
+#include "uio.h"
 
 // Fetch the nth word-sized system call argument as a file descriptor
 // and return both the descriptor and the corresponding struct file.
@@ -85,11 +86,132 @@ sys_write(void)
   int n;
   char *p;
 
-  if(argfd(0, 0, &f) < 0 || argint(2, &n) < 0 || argptr(1, &p, n) < 0)
+  if(argfd(0, 0, &f) < 0 || argint(2, &n) < 0 || argbuf(1, &p, n) < 0)
     return -1;
   return filewrite(f, p, n);
 }
 
+// Fetch the nth argument as an array of cnt iovecs into iov,
+// and check that each buffer lies in the process.
+static int
+argiov(int n, int cnt, struct iovec *iov)
+{
+  struct proc *curproc = myproc();
+  int i, addr;
+
+  if(cnt < 0 || cnt > IOVMAX || argint(n, &addr) < 0)
+    return -1;
+  if(ucopyin(iov, (char*)addr, cnt*sizeof(struct iovec)) < 0)
+    return -1;
+  for(i = 0; i < cnt; i++){
+    addr = (int)iov[i].iov_base;
+    if(iov[i].iov_len < 0 || (uint)addr >= curproc->sz ||
+       (uint)addr+iov[i].iov_len > curproc->sz)
+      return -1;
+  }
+  return 0;
+}
+
+int
+sys_readv(void)
+{
+  struct file *f;
+  struct iovec iov[IOVMAX];
+  int cnt;
+
+  if(argfd(0, 0, &f) < 0 || argint(2, &cnt) < 0 || argiov(1, cnt, iov) < 0)
+    return -1;
+  return filereadv(f, iov, cnt, -1);
+}
+
+// Write all the buffers in as few log transactions as fit.
+int
+sys_writev(void)
+{
+  struct file *f;
+  struct iovec iov[IOVMAX];
+  int cnt;
+
+  if(argfd(0, 0, &f) < 0 || argint(2, &cnt) < 0 || argiov(1, cnt, iov) < 0)
+    return -1;
+  return filewritev(f, iov, cnt, -1);
+}
+
+// Read at offset off without moving the file offset.
+int
+sys_pread(void)
+{
+  struct file *f;
+  struct iovec iov;
+  int n, off;
+  char *p;
+
+  if(argfd(0, 0, &f) < 0 || argint(2, &n) < 0 || argptr(1, &p, n) < 0 ||
+     argint(3, &off) < 0 || off < 0)
+    return -1;
+  iov.iov_base = p;
+  iov.iov_len = n;
+  return filereadv(f, &iov, 1, off);
+}
+
+// Write at offset off without moving the file offset.
+int
+sys_pwrite(void)
+{
+  struct file *f;
+  struct iovec iov;
+  int n, off;
+  char *p;
+
+  if(argfd(0, 0, &f) < 0 || argint(2, &n) < 0 || argbuf(1, &p, n) < 0 ||
+     argint(3, &off) < 0 || off < 0)
+    return -1;
+  iov.iov_base = p;
+  iov.iov_len = n;
+  return filewritev(f, &iov, 1, off);
+}
+
+// Write to a pipe like write(), but move whole page-aligned
+// pages of the buffer into the pipe instead of copying them;
+// they read as zeros afterwards.
+int
+sys_vmsplice(void)
+{
+  struct file *f;
+  int n;
+  char *p;
+
+  if(argfd(0, 0, &f) < 0 || argint(2, &n) < 0 || argptr(1, &p, n) < 0)
+    return -1;
+  if(f->type != FD_PIPE || f->writable == 0)
+    return -1;
+  return pipewrite(f->pipe, p, n, 1);
+}
+
+// Map a file into memory. The address argument is only a
+// hint, and ignored.
+int
+sys_mmap(void)
+{
+  struct file *f;
+  int len, prot, flags, off;
+
+  if(argint(1, &len) < 0 || argint(2, &prot) < 0 || argint(3, &flags) < 0 ||
+     argfd(4, 0, &f) < 0 || argint(5, &off) < 0 || off < 0)
+    return -1;
+  return mmap(f, len, prot, flags, off);
+}
+
+int
+sys_munmap(void)
+{
+  int addr, len;
+
+  if(argint(0, &addr) < 0 || argint(1, &len) < 0)
+    return -1;
+  return munmap(addr, len);
+}
+
 int
 sys_close(void)
 {
@@ -114,6 +236,16 @@ sys_fstat(void)
   return filestat(f, st);
 }
 
+int
+sys_fsync(void)
+{
+  struct file *f;
+
+  if(argfd(0, 0, &f) < 0)
+    return -1;
+  return filesync(f);
+}
+
 // Create the path new as a link to the same inode as old.
 int
 sys_link(void)
@@ -185,7 +317,6 @@ int
 sys_unlink(void)
 {
   struct inode *ip, *dp;
-  struct dirent de;
   char name[DIRSIZ], *path;
   uint off;
 
@@ -215,9 +346,7 @@ sys_unlink(void)
     goto bad;
   }
 
-  memset(&de, 0, sizeof(de));
-  if(writei(dp, (char*)&de, off, sizeof(de)) != sizeof(de))
-    panic("unlink: writei");
+  dirunlink(dp, name, off);
   if(ip->type == T_DIR){
     dp->nlink--;
     iupdate(dp);
@@ -258,7 +387,7 @@ create(char *path, short type, short major, short minor)
     return 0;
   }
 
-  if((ip = ialloc(dp->dev, type)) == 0)
+  if((ip = ialloc(dp->dev, type, dp->inum)) == 0)
     panic("create: ialloc");
 
   ilock(ip);
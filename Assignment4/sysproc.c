@@ -6,6 +6,7 @@
 #include "memlayout.h"
 #include "mmu.h"
 #include "proc.h"
+#include "clock.h"
 
 int
 sys_fork(void)
@@ -60,20 +61,37 @@ int
 sys_sleep(void)
 {
   int n;
-  uint ticks0;
 
-  if(argint(0, &n) < 0)
+  if(argint(0, &n) < 0 || n < 0)
+    return -1;
+  return jsleep(n * TICKDIV);
+}
+
+// Sleep for the time in a struct timespec, to the jiffy.
+int
+sys_nanosleep(void)
+{
+  struct timespec *ts, t;
+
+  if(argptr(0, (void*)&ts, sizeof(*ts)) < 0)
     return -1;
-  acquire(&tickslock);
-  ticks0 = ticks;
-  while(ticks - ticks0 < n){
-    if(myproc()->killed){
-      release(&tickslock);
-      return -1;
-    }
-    sleep(&ticks, &tickslock);
-  }
-  release(&tickslock);
+  t = *ts;
+  return nsleep(&t);
+}
+
+// The system call behind clock_gettime() in ulib.c, which
+// reads the vdso page instead.
+int
+sys_clocktime(void)
+{
+  int clock;
+  struct timespec *ts;
+
+  if(argint(0, &clock) < 0 || argptr(1, (void*)&ts, sizeof(*ts)) < 0)
+    return -1;
+  if(clock != CLOCK_MONOTONIC)
+    return -1;
+  clockread(ts);
   return 0;
 }
 
@@ -82,10 +100,7 @@ sys_sleep(void)
 int
 sys_uptime(void)
 {
-  uint xticks;
-
-  acquire(&tickslock);
-  xticks = ticks;
-  release(&tickslock);
-  return xticks;
+  // Only CPU 0 writes ticks, a word at a time, so it can be
+  // read without tickslock.
+  return ticks;
 }
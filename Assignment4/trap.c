@@ -36,6 +36,9 @@ idtinit(void)
 void
 trap(struct trapframe *tf)
 {
+  uint fixup;
+  int tick = 0;
+
   if(tf->trapno == T_SYSCALL){
     if(myproc()->killed)
       exit();
@@ -48,12 +51,10 @@ trap(struct trapframe *tf)
 
   switch(tf->trapno){
   case T_IRQ0 + IRQ_TIMER:
-    if(cpuid() == 0){
-      acquire(&tickslock);
-      ticks++;
-      wakeup(&ticks);
-      release(&tickslock);
-    }
+    // Each CPU counts its own jiffies; every TICKDIV-th is a tick.
+    tick = ++mycpu()->jiffies % TICKDIV == 0;
+    if(cpuid() == 0)
+      clockintr(tick);
     lapiceoi();
     break;
   case T_IRQ0 + IRQ_IDE:
@@ -80,6 +81,15 @@ trap(struct trapframe *tf)
 
   //PAGEBREAK: 13
   default:
+    if(tf->trapno == T_PGFLT && (tf->cs&3) == DPL_USER &&
+       vmafault(rcr2()) == 0)
+      break;  // first touch of a mapped file's page
+    if(tf->trapno == T_PGFLT && (tf->cs&3) == 0 &&
+       (fixup = extable_fixup(tf->eip)) != 0){
+      // A user copy faulted; make it fail instead.
+      tf->eip = fixup;
+      break;
+    }
     if(myproc() == 0 || (tf->cs&3) == 0){
       // In kernel, it must be our mistake.
       cprintf("unexpected trap %d from cpu %d eip %x (cr2=0x%x)\n",
@@ -102,8 +112,7 @@ trap(struct trapframe *tf)
 
   // Force process to give up CPU on clock tick.
   // If interrupts were on while locks held, would need to check nlock.
-  if(myproc() && myproc()->state == RUNNING &&
-     tf->trapno == T_IRQ0+IRQ_TIMER)
+  if(myproc() && myproc()->state == RUNNING && tick)
     yield();
 
   // Check if the process has been killed since we yielded
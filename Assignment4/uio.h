@@ -0,0 +1,5 @@
+// One buffer of a readv() or writev().
+struct iovec {
+  void *iov_base;
+  int iov_len;
+};
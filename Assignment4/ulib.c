@@ -3,6 +3,7 @@
 #include "fcntl.h"
 #include "user.h"
 #include "x86.h"
+#include "clock.h"
 
 char*
 strcpy(char *s, const char *t)
@@ -102,6 +103,35 @@ atoi(const char *s)
   return n;
 }
 
+// Return the number after label at the start of a line of
+// the file path, such as "Commits: " in /proc/loginfo, or -1.
+int
+procinfo(const char *path, const char *label)
+{
+  static char info[1024];
+  char *p;
+  int fd, n, i;
+
+  if((fd = open(path, O_RDONLY)) < 0)
+    return -1;
+  n = read(fd, info, sizeof(info)-1);
+  close(fd);
+  if(n <= 0)
+    return -1;
+  info[n] = 0;
+  for(p = info; *p; p++){
+    for(i = 0; label[i] && p[i] == label[i]; i++)
+      ;
+    if(label[i] == 0)
+      return atoi(p + i);
+    while(*p && *p != '\n')
+      p++;
+    if(*p == 0)
+      break;
+  }
+  return -1;
+}
+
 void*
 memmove(void *vdst, const void *vsrc, int n)
 {
@@ -114,3 +144,38 @@ memmove(void *vdst, const void *vsrc, int n)
     *dst++ = *src++;
   return vdst;
 }
+
+// Read the monotonic clock from the vdso page, without a system
+// call: the time the kernel stored at the last timer interrupt,
+// plus the TSC cycles since. The kernel bumps seq before and
+// after each update, so an odd or changed seq means try again.
+int
+clock_gettime(int clock, struct timespec *ts)
+{
+  volatile struct vdso *vd = (volatile struct vdso*)VDSO;
+  unsigned long long tsc;
+  uint seq, sec, nsec, mult;
+
+  if(clock != CLOCK_MONOTONIC)
+    return -1;
+  do {
+    while((seq = vd->seq) & 1)
+      ;
+    __sync_synchronize();
+    tsc = vd->tsc;
+    sec = vd->sec;
+    nsec = vd->nsec;
+    mult = vd->mult;
+    __sync_synchronize();
+  } while(vd->seq != seq);
+
+  if(mult)
+    nsec += (rdtsc() - tsc) * mult >> CLOCKSHIFT;
+  while(nsec >= NSEC){
+    nsec -= NSEC;
+    sec++;
+  }
+  ts->tv_sec = sec;
+  ts->tv_nsec = nsec;
+  return 0;
+}
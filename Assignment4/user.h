@@ -1,5 +1,7 @@
 struct stat;
 struct rtcdate;
+struct iovec;
+struct timespec;
 
 // system calls
 int fork(void);
@@ -23,6 +25,16 @@ int getpid(void);
 char* sbrk(int);
 int sleep(int);
 int uptime(void);
+int vmsplice(int, void*, int);
+int readv(int, struct iovec*, int);
+int writev(int, struct iovec*, int);
+int pread(int, void*, int, int);
+int pwrite(int, void*, int, int);
+void* mmap(void*, int, int, int, int, int);
+int munmap(void*, int);
+int fsync(int);
+int clocktime(int, struct timespec*);
+int nanosleep(struct timespec*);
 
 // ulib.c
 int stat(const char*, struct stat*);
@@ -37,4 +49,6 @@ void* memset(void*, int, uint);
 void* malloc(uint);
 void free(void*);
 int atoi(const char*);
+int procinfo(const char*, const char*);
+int clock_gettime(int, struct timespec*);
 int index_of(char *, char , int );
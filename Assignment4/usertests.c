@@ -7,6 +7,8 @@
 #include "syscall.h"
 #include "traps.h"
 #include "memlayout.h"
+#include "uio.h"
+#include "clock.h"
 
 char buf[8192];
 char name[3];
@@ -931,6 +933,446 @@ bigdir(void)
   printf(1, "bigdir ok\n");
 }
 
+// name cache: negative entries must not hide new names and
+// positive ones must not outlive unlink or their directory
+void
+dcachetest(void)
+{
+  int fd;
+
+  printf(1, "dcache test\n");
+
+  if(open("dcf", O_RDONLY) >= 0 || open("dcg", O_RDONLY) >= 0){
+    printf(1, "dcache: dcf exists\n");
+    exit();
+  }
+  fd = open("dcf", O_CREATE|O_RDWR);
+  if(fd < 0){
+    printf(1, "dcache: create dcf failed\n");
+    exit();
+  }
+  close(fd);
+  if(open("dcf", O_RDONLY) < 0){
+    printf(1, "dcache: negative entry hides dcf\n");
+    exit();
+  }
+  if(link("dcf", "dcg") != 0 || (fd = open("dcg", O_RDONLY)) < 0){
+    printf(1, "dcache: negative entry hides link dcg\n");
+    exit();
+  }
+  close(fd);
+  if(unlink("dcf") != 0 || unlink("dcg") != 0){
+    printf(1, "dcache: unlink failed\n");
+    exit();
+  }
+  if(open("dcf", O_RDONLY) >= 0 || open("dcg", O_RDONLY) >= 0){
+    printf(1, "dcache: unlinked name still found\n");
+    exit();
+  }
+
+  if(mkdir("dcd") != 0){
+    printf(1, "dcache: mkdir dcd failed\n");
+    exit();
+  }
+  fd = open("dcd/f", O_CREATE|O_RDWR);
+  if(fd < 0){
+    printf(1, "dcache: create dcd/f failed\n");
+    exit();
+  }
+  close(fd);
+  if(unlink("dcd/f") != 0 || unlink("dcd") != 0){
+    printf(1, "dcache: unlink dcd failed\n");
+    exit();
+  }
+  if(mkdir("dcd") != 0){
+    printf(1, "dcache: mkdir dcd again failed\n");
+    exit();
+  }
+  if(open("dcd/f", O_RDONLY) >= 0){
+    printf(1, "dcache: dcd/f outlived its directory\n");
+    exit();
+  }
+  unlink("dcd");
+
+  printf(1, "dcache ok\n");
+}
+
+// hold more inodes at once than the old fixed icache of
+// NINODE, look them up again while they are held, and check
+// that /proc/icacheinfo counted the lookups as hits
+void
+icachetest(void)
+{
+  enum { NCHILD = 5, NPER = 12, NAGAIN = 3 };
+  int i, j, fd, pid, go[2], ready[2], lookups, hits;
+  char name[4], c;
+
+  printf(1, "icache test\n");
+
+  name[0] = 'i';
+  name[3] = '\0';
+  for(i = 0; i < NCHILD*NPER; i++){
+    name[1] = '0' + i / 10;
+    name[2] = '0' + i % 10;
+    fd = open(name, O_CREATE|O_RDWR);
+    if(fd < 0){
+      printf(1, "icache: create %s failed\n", name);
+      exit();
+    }
+    close(fd);
+  }
+
+  if(pipe(go) != 0 || pipe(ready) != 0){
+    printf(1, "icache: pipe failed\n");
+    exit();
+  }
+  for(i = 0; i < NCHILD; i++){
+    pid = fork();
+    if(pid < 0){
+      printf(1, "icache: fork failed\n");
+      exit();
+    }
+    if(pid == 0){
+      close(go[1]);
+      for(j = 0; j < NPER; j++){
+        name[1] = '0' + (i*NPER + j) / 10;
+        name[2] = '0' + (i*NPER + j) % 10;
+        if(open(name, O_RDONLY) < 0){
+          printf(1, "icache: open %s failed\n", name);
+          exit();
+        }
+      }
+      write(ready[1], "x", 1);
+      read(go[0], &c, 1);  // hold the files until the parent is done
+      exit();
+    }
+  }
+  close(go[0]);
+  for(i = 0; i < NCHILD; i++)
+    read(ready[0], &c, 1);
+
+  lookups = procinfo("/proc/icacheinfo", "Lookups: ");
+  hits = procinfo("/proc/icacheinfo", "Hits: ");
+  if(lookups < 0 || hits < 0){
+    printf(1, "icache: no counters in /proc/icacheinfo\n");
+    exit();
+  }
+  for(j = 0; j < NAGAIN; j++){
+    for(i = 0; i < NCHILD*NPER; i++){
+      name[1] = '0' + i / 10;
+      name[2] = '0' + i % 10;
+      if((fd = open(name, O_RDONLY)) < 0){
+        printf(1, "icache: open %s again failed\n", name);
+        exit();
+      }
+      close(fd);
+    }
+  }
+  lookups = procinfo("/proc/icacheinfo", "Lookups: ") - lookups;
+  hits = procinfo("/proc/icacheinfo", "Hits: ") - hits;
+  if(lookups < NAGAIN*NCHILD*NPER || hits < NAGAIN*NCHILD*NPER){
+    printf(1, "icache: held inodes not counted as hits\n");
+    exit();
+  }
+  printf(1, "icache: %d inodes, %d in use, %d hits of %d lookups\n",
+         procinfo("/proc/icacheinfo", "Inodes: "),
+         procinfo("/proc/icacheinfo", "In use: "), hits, lookups);
+
+  close(go[1]);
+  for(i = 0; i < NCHILD; i++)
+    wait();
+  close(ready[0]);
+  close(ready[1]);
+
+  for(i = 0; i < NCHILD*NPER; i++){
+    name[1] = '0' + i / 10;
+    name[2] = '0' + i % 10;
+    unlink(name);
+  }
+  printf(1, "icache ok\n");
+}
+
+// writev() of many buffers, more than fit in one log
+// transaction, read back with readv() and pread().
+void
+iovtest(void)
+{
+  enum { NIOV = 40, LEN = 100 };
+  struct iovec iov[NIOV];
+  int i, j, fd, off;
+  char c;
+
+  printf(1, "iov test\n");
+
+  for(i = 0; i < NIOV; i++){
+    iov[i].iov_base = buf + i*LEN;
+    iov[i].iov_len = LEN;
+    memset(buf + i*LEN, 'a' + i % 26, LEN);
+  }
+  fd = open("iovfile", O_CREATE|O_RDWR);
+  if(fd < 0){
+    printf(1, "iov: create failed\n");
+    exit();
+  }
+  if(writev(fd, iov, NIOV) != NIOV*LEN){
+    printf(1, "iov: writev failed\n");
+    exit();
+  }
+  if(pwrite(fd, "Z", 1, 5) != 1 || write(fd, "!", 1) != 1){
+    printf(1, "iov: pwrite failed\n");
+    exit();
+  }
+  close(fd);
+
+  fd = open("iovfile", O_RDONLY);
+  memset(buf, 0, NIOV*LEN);
+  if(readv(fd, iov, NIOV) != NIOV*LEN){
+    printf(1, "iov: readv failed\n");
+    exit();
+  }
+  for(i = 0; i < NIOV; i++){
+    for(j = 0; j < LEN; j++){
+      c = i == 0 && j == 5 ? 'Z' : 'a' + i % 26;
+      if(buf[i*LEN + j] != c){
+        printf(1, "iov: wrong data at %d\n", i*LEN + j);
+        exit();
+      }
+    }
+  }
+  for(off = 0; off < NIOV*LEN; off += 997){
+    if(pread(fd, &c, 1, off) != 1 || c != buf[off]){
+      printf(1, "iov: pread at %d failed\n", off);
+      exit();
+    }
+  }
+  if(read(fd, &c, 1) != 1 || c != '!'){
+    printf(1, "iov: pread moved the offset\n");
+    exit();
+  }
+  close(fd);
+  unlink("iovfile");
+  printf(1, "iov ok\n");
+}
+
+// Stores to a MAP_SHARED mapping reach the file and a child's
+// mapping of it; stores to a MAP_PRIVATE one do not.
+void
+mmaptest(void)
+{
+  enum { SZ = 3*4096 + 100 };
+  int i, j, fd, pid;
+  char *p, *q;
+
+  printf(1, "mmap test\n");
+
+  fd = open("mmapfile", O_CREATE|O_RDWR);
+  for(i = 0; i < SZ; i += sizeof(buf)){
+    for(j = 0; j < sizeof(buf); j++)
+      buf[j] = 'a' + (i + j) % 26;
+    write(fd, buf, SZ - i < sizeof(buf) ? SZ - i : sizeof(buf));
+  }
+
+  p = mmap(0, SZ, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+  q = mmap(0, SZ, PROT_READ|PROT_WRITE, MAP_PRIVATE, fd, 0);
+  if(p == (char*)-1 || q == (char*)-1 || p == q){
+    printf(1, "mmap: mmap failed\n");
+    exit();
+  }
+  for(i = 0; i < SZ; i++){
+    if(p[i] != 'a' + i % 26 || q[i] != p[i]){
+      printf(1, "mmap: wrong data at %d\n", i);
+      exit();
+    }
+  }
+  p[0] = 'X';
+  p[SZ-1] = 'Y';
+  q[1] = 'Z';
+  if(q[0] != 'a' || p[1] != 'b'){
+    printf(1, "mmap: private and shared pages mixed\n");
+    exit();
+  }
+
+  pid = fork();
+  if(pid < 0){
+    printf(1, "mmap: fork failed\n");
+    exit();
+  }
+  if(pid == 0){
+    if(p[0] != 'X' || q[1] != 'Z'){
+      printf(1, "mmap: child sees wrong data\n");
+      exit();
+    }
+    p[2] = 'W';
+    exit();
+  }
+  wait();
+  if(p[2] != 'W'){
+    printf(1, "mmap: child store not shared\n");
+    exit();
+  }
+  if(munmap(p, SZ) < 0 || munmap(q, SZ) < 0){
+    printf(1, "mmap: munmap failed\n");
+    exit();
+  }
+  close(fd);
+
+  fd = open("mmapfile", O_RDONLY);
+  if(read(fd, buf, 3) != 3 || buf[0] != 'X' || buf[1] != 'b' || buf[2] != 'W'){
+    printf(1, "mmap: stores not written back\n");
+    exit();
+  }
+  close(fd);
+  unlink("mmapfile");
+  printf(1, "mmap ok\n");
+}
+
+// Small appends are seen by stat and read before they are
+// written back, and fsync() writes them back.
+void
+fsynctest(void)
+{
+  enum { NREC = 300, LEN = 37 };
+  struct stat st;
+  int i, j, fd, fds[2], dirty, commits;
+
+  printf(1, "fsync test\n");
+
+  dirty = procinfo("/proc/pcacheinfo", "Dirty pages: ");
+  commits = procinfo("/proc/loginfo", "Commits: ");
+  if(dirty < 0 || commits < 0){
+    printf(1, "fsync: no counters in /proc\n");
+    exit();
+  }
+  fd = open("fsyncfile", O_CREATE|O_RDWR);
+  if(fd < 0){
+    printf(1, "fsync: create failed\n");
+    exit();
+  }
+  for(i = 0; i < NREC; i++){
+    memset(buf, 'a' + i % 26, LEN);
+    if(write(fd, buf, LEN) != LEN){
+      printf(1, "fsync: write failed\n");
+      exit();
+    }
+  }
+  if(fstat(fd, &st) < 0 || st.size != NREC*LEN){
+    printf(1, "fsync: wrong size before fsync\n");
+    exit();
+  }
+  if(fsync(fd) < 0){
+    printf(1, "fsync: fsync failed\n");
+    exit();
+  }
+  // Other files may still have dirty pages, but none of this
+  // one's may be left, and they must have reached the log.
+  if(procinfo("/proc/pcacheinfo", "Dirty pages: ") > dirty){
+    printf(1, "fsync: pages still dirty after fsync\n");
+    exit();
+  }
+  if(procinfo("/proc/loginfo", "Commits: ") <= commits){
+    printf(1, "fsync: nothing committed\n");
+    exit();
+  }
+  close(fd);
+
+  fd = open("fsyncfile", O_RDONLY);
+  for(i = 0; i < NREC; i++){
+    if(read(fd, buf, LEN) != LEN){
+      printf(1, "fsync: short read\n");
+      exit();
+    }
+    for(j = 0; j < LEN; j++){
+      if(buf[j] != 'a' + i % 26){
+        printf(1, "fsync: wrong data at %d\n", i*LEN + j);
+        exit();
+      }
+    }
+  }
+  close(fd);
+  unlink("fsyncfile");
+
+  if(pipe(fds) < 0){
+    printf(1, "fsync: pipe failed\n");
+    exit();
+  }
+  if(fsync(fds[0]) >= 0){
+    printf(1, "fsync: fsync of a pipe succeeded\n");
+    exit();
+  }
+  close(fds[0]);
+  close(fds[1]);
+  printf(1, "fsync ok\n");
+}
+
+// Nanoseconds from a to b, or -1 if b is before a or more than
+// two seconds after it.
+int
+nsbetween(struct timespec *a, struct timespec *b)
+{
+  uint sec, nsec;
+
+  if(b->tv_sec < a->tv_sec ||
+     (b->tv_sec == a->tv_sec && b->tv_nsec < a->tv_nsec))
+    return -1;
+  sec = b->tv_sec - a->tv_sec;
+  if(b->tv_nsec < a->tv_nsec){
+    sec--;
+    nsec = b->tv_nsec + NSEC - a->tv_nsec;
+  } else
+    nsec = b->tv_nsec - a->tv_nsec;
+  if(sec >= 2)
+    return -1;
+  return sec*NSEC + nsec;
+}
+
+// The clock read from the vdso page and through the system
+// call agree and never go back, and nanosleep() sleeps at
+// least as long as asked.
+void
+clocktest(void)
+{
+  struct timespec a, b, d;
+  int i, ns;
+
+  printf(1, "clock test\n");
+
+  if(clock_gettime(CLOCK_MONOTONIC, &a) < 0 ||
+     clocktime(CLOCK_MONOTONIC, &b) < 0){
+    printf(1, "clock: cannot read the clock\n");
+    exit();
+  }
+  if(nsbetween(&a, &b) < 0){
+    printf(1, "clock: vdso and system call disagree\n");
+    exit();
+  }
+  for(i = 0; i < 10000; i++){
+    clock_gettime(CLOCK_MONOTONIC, &b);
+    if(nsbetween(&a, &b) < 0){
+      printf(1, "clock: went back\n");
+      exit();
+    }
+    a = b;
+  }
+  if(clocktime(CLOCK_MONOTONIC + 1, &a) >= 0){
+    printf(1, "clock: unknown clock read\n");
+    exit();
+  }
+
+  d.tv_sec = 0;
+  d.tv_nsec = 3000000;
+  clock_gettime(CLOCK_MONOTONIC, &a);
+  if(nanosleep(&d) < 0){
+    printf(1, "clock: nanosleep failed\n");
+    exit();
+  }
+  clock_gettime(CLOCK_MONOTONIC, &b);
+  if((ns = nsbetween(&a, &b)) < 3000000){
+    printf(1, "clock: nanosleep of 3000000 ns took %d ns\n", ns);
+    exit();
+  }
+  printf(1, "clock ok\n");
+}
+
 void
 subdir(void)
 {
@@ -1794,6 +2236,12 @@ main(int argc, char *argv[])
   iref();
   forktest();
   bigdir(); // slow
+  dcachetest();
+  icachetest();
+  iovtest();
+  mmaptest();
+  fsynctest();
+  clocktest();
 
   uio();
 
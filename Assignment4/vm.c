@@ -6,6 +6,7 @@
 #include "mmu.h"
 #include "proc.h"
 #include "elf.h"
+#include "clock.h"
 
 extern char data[];  // defined by kernel.ld
 pde_t *kpgdir;  // for use in scheduler()
@@ -32,7 +33,7 @@ seginit(void)
 // Return the address of the PTE in page table pgdir
 // that corresponds to virtual address va.  If alloc!=0,
 // create any required page table pages.
-static pte_t *
+pte_t *
 walkpgdir(pde_t *pgdir, const void *va, int alloc)
 {
   pde_t *pde;
@@ -57,7 +58,7 @@ walkpgdir(pde_t *pgdir, const void *va, int alloc)
 // Create PTEs for virtual addresses starting at va that refer to
 // physical addresses starting at pa. va and size might not
 // be page-aligned.
-static int
+int
 mappages(pde_t *pgdir, void *va, uint size, uint pa, int perm)
 {
   char *a, *last;
@@ -114,7 +115,8 @@ static struct kmap {
  { (void*)DEVSPACE, DEVSPACE,      0,         PTE_W}, // more devices
 };
 
-// Set up kernel part of a page table.
+// Set up kernel part of a page table, and the read-only
+// vdso page (see clock.c) that every process shares.
 pde_t*
 setupkvm(void)
 {
@@ -132,6 +134,10 @@ setupkvm(void)
       freevm(pgdir);
       return 0;
     }
+  if(vdsomap(pgdir) < 0){
+    freevm(pgdir);
+    return 0;
+  }
   return pgdir;
 }
 
@@ -287,7 +293,7 @@ freevm(pde_t *pgdir)
 
   if(pgdir == 0)
     panic("freevm: no pgdir");
-  deallocuvm(pgdir, KERNBASE, 0);
+  deallocuvm(pgdir, VDSO, 0);  // the vdso page is not the process's
   for(i = 0; i < NPDENTRIES; i++){
     if(pgdir[i] & PTE_P){
       char * v = P2V(PTE_ADDR(pgdir[i]));
@@ -359,6 +365,112 @@ uva2ka(pde_t *pgdir, char *uva)
   return (char*)P2V(PTE_ADDR(*pte));
 }
 
+// Map the page at kernel address mem at the page-aligned user
+// address uva of the current process instead of the page there,
+// and return that page. Returns 0, changing nothing, if uva is
+// not a present, writable user page of the process's own.
+char*
+uswappage(pde_t *pgdir, char *uva, char *mem)
+{
+  pte_t *pte;
+  char *old;
+
+  if((pte = walkpgdir(pgdir, uva, 0)) == 0)
+    return 0;
+  if((*pte & (PTE_P|PTE_U|PTE_W|PTE_SHARED)) != (PTE_P|PTE_U|PTE_W))
+    return 0;
+  old = P2V(PTE_ADDR(*pte));
+  *pte = V2P(mem) | PTE_FLAGS(*pte);
+  lcr3(V2P(pgdir));  // flush the old translation
+  return old;
+}
+
+//PAGEBREAK!
+// Copies to and from the current process's memory. The range is
+// checked against p->sz and then copied by a single rep movs,
+// without walking the page table first. If a page turns out to
+// be missing or read-only, the copy faults and trap() resumes it
+// at the fixup its entry in the exception table names, so the
+// copy returns -1 instead of the kernel panicking.
+
+struct extable {
+  uint insn;   // instruction that may fault on a user address
+  uint fixup;  // where to resume if it does
+};
+
+extern struct extable __ex_table_start[], __ex_table_end[];
+
+static int
+ucopy(void *dst, const void *src, uint n)
+{
+  uint words = n / 4;
+  int r;
+
+  asm volatile("cld\n"
+               "1: rep movsl\n"
+               "   movl %%edx, %%ecx\n"
+               "2: rep movsb\n"
+               "   xorl %0, %0\n"
+               "   jmp 4f\n"
+               "3: movl $-1, %0\n"
+               "4:\n"
+               ".pushsection __ex_table, \"a\"\n"
+               "   .long 1b, 3b\n"
+               "   .long 2b, 3b\n"
+               ".popsection\n" :
+               "=&a" (r), "+D" (dst), "+S" (src), "+c" (words) :
+               "d" (n % 4) :
+               "memory", "cc");
+  return r;
+}
+
+// Is [uva, uva+n) inside the current process's memory or
+// one of its mapped files?
+static int
+uvalid(uint uva, uint n)
+{
+  uint sz = myproc()->sz;
+
+  if(uva < sz && uva + n <= sz && uva + n >= uva)
+    return 1;
+  return vmarange(uva, n);
+}
+
+// Copy n bytes from user address uva to dst.
+int
+ucopyin(void *dst, char *uva, uint n)
+{
+  if(n == 0)
+    return 0;
+  if(!uvalid((uint)uva, n))
+    return -1;
+  return ucopy(dst, uva, n);
+}
+
+// Copy n bytes from src to user address uva.
+int
+ucopyout(char *uva, void *src, uint n)
+{
+  if(n == 0)
+    return 0;
+  if(!uvalid((uint)uva, n))
+    return -1;
+  return ucopy(uva, src, n);
+}
+
+// Where to resume a kernel fault at eip, or 0 if the
+// instruction is not in the exception table.
+uint
+extable_fixup(uint eip)
+{
+  struct extable *e;
+
+  for(e = __ex_table_start; e < __ex_table_end; e++)
+    if(e->insn == eip)
+      return e->fixup;
+  return 0;
+}
+
 // Copy len bytes from p to user address va in page table pgdir.
 // Most useful when pgdir is not the current page table.
 // uva2ka ensures this only works for PTE_U pages.